@@ -0,0 +1,41 @@
+#ifndef FFTOOLS_BENCH_H
+#define FFTOOLS_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/time.h"
+
+/**
+ * Helpers shared by the benchmark programs. Each program runs its cases one
+ * after the other and prints one line per result, so runs before and after a
+ * change can be diffed.
+ */
+
+/**
+ * @return the first command line argument as a positive count, def if it is
+ *         missing or invalid
+ */
+static inline int bench_count(int argc, char **argv, int def)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 0;
+    return n > 0 ? n : def;
+}
+
+/* print a result named after the case and what was measured */
+static inline void bench_report(const char *name, const char *what,
+                                double value, const char *unit)
+{
+    printf("%-40s %-24s %14.2f %s\n", name, what, value, unit);
+    fflush(stdout);
+}
+
+/* print the rate of nb operations done in elapsed microseconds */
+static inline void bench_report_rate(const char *name, const char *what,
+                                     int64_t nb, int64_t elapsed)
+{
+    bench_report(name, what, elapsed > 0 ? nb * 1e6 / elapsed : 0, "/s");
+}
+
+#endif // FFTOOLS_BENCH_H
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libavutil/macros.h"
+#include "libavutil/time.h"
+
+#include "bench.h"
+#include "fftools_api.h"
+
+/*
+ * Time from fftools_session_cancel() until fftools_session_join() returns,
+ * for an execution busy transcoding and for one whose demuxer waits on a
+ * pipe that stopped delivering data, with and without -readahead.
+ *
+ * usage: bench_cancel_latency [repetitions]
+ */
+
+/* how long executions run before being cancelled, in microseconds */
+#define RUN_TIME 300000
+
+/* s16le at 8 kHz mono, fits into the pipe buffer without blocking */
+#define PIPE_DATA_SIZE 16000
+
+/* @return the cancel to return latency in microseconds, -1 on failure */
+static int64_t run(char **argv, int argc)
+{
+    FFToolsConfig config;
+    FFToolsSession *s;
+    int64_t start;
+
+    fftools_config_init(&config);
+    config.log_level = AV_LOG_QUIET;
+
+    if (ffmpeg_submit_with_config(argc, argv, &config, &s) < 0)
+        return -1;
+    /* deliver whatever it sends while running, as a caller would */
+    start = av_gettime_relative();
+    while (av_gettime_relative() - start < RUN_TIME)
+        fftools_session_receive_timeout(s, 10);
+
+    start = av_gettime_relative();
+    fftools_session_cancel(s);
+    fftools_session_join(s);
+    return av_gettime_relative() - start;
+}
+
+static int64_t run_lavfi(void)
+{
+    char *argv[] = {
+        "ffmpeg", "-hide_banner", "-f", "lavfi", "-i", "testsrc=size=320x240",
+        "-f", "null", "-", NULL
+    };
+
+    return run(argv, FF_ARRAY_ELEMS(argv) - 1);
+}
+
+/* the pipe is written to once and then kept open, leaving the demuxer
+ * waiting for more */
+static int64_t run_pipe(const char *readahead)
+{
+    static const uint8_t data[PIPE_DATA_SIZE];
+    char input[32];
+    char *argv[] = {
+        "ffmpeg", "-hide_banner", "-readahead", (char *)readahead,
+        "-f", "s16le", "-ar", "8000", "-ac", "1", "-i", input,
+        "-f", "null", "-", NULL
+    };
+    int64_t ret = -1;
+    int fds[2];
+
+    if (pipe(fds) < 0)
+        return -1;
+    if (write(fds[1], data, sizeof(data)) == sizeof(data)) {
+        snprintf(input, sizeof(input), "pipe:%d", fds[0]);
+        ret = run(argv, FF_ARRAY_ELEMS(argv) - 1);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return ret;
+}
+
+static void report(const char *name, int64_t total, int64_t worst, int nb)
+{
+    if (!nb) {
+        fprintf(stderr, "%s: execution failed\n", name);
+        return;
+    }
+    bench_report(name, "cancel to return", (double)total / nb, "us");
+    bench_report(name, "cancel to return, worst", worst, "us");
+}
+
+int main(int argc, char **argv)
+{
+    int nb = bench_count(argc, argv, 10);
+    static const struct {
+        const char *name;
+        const char *readahead;
+    } cases[] = {
+        { "transcoding lavfi",          NULL      },
+        { "stalled pipe",               "0"       },
+        { "stalled pipe, -readahead",   "1048576" },
+    };
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(cases); i++) {
+        int64_t total = 0, worst = 0;
+        int done = 0;
+
+        for (int j = 0; j < nb; j++) {
+            int64_t latency = cases[i].readahead ? run_pipe(cases[i].readahead) :
+                                                   run_lavfi();
+            if (latency < 0)
+                break;
+            total += latency;
+            worst  = FFMAX(worst, latency);
+            done++;
+        }
+        report(cases[i].name, total, worst, done);
+    }
+
+    return 0;
+}
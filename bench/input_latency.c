@@ -0,0 +1,160 @@
+#include <inttypes.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "libavutil/macros.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "bench.h"
+#include "fftools_api.h"
+
+/*
+ * Latency of ffmpeg with two live pipe inputs: the time from writing a packet
+ * worth of audio to each input until the packet shows up in the output, a
+ * framecrc written to a pipe and flushed after every packet. Two live inputs
+ * make the demuxers non-blocking, so the main loop waits on them.
+ *
+ * usage: bench_input_latency [packets per input]
+ */
+
+#define SAMPLE_RATE    8000
+/* what the pcm demuxer puts in one packet, 16 bit mono */
+#define CHUNK_SAMPLES  1024
+#define CHUNK_SIZE     (CHUNK_SAMPLES * 2)
+/* time between two packets, in microseconds */
+#define CHUNK_INTERVAL 40000
+/* packets left out of the results while the inputs are opened and probed */
+#define WARMUP_CHUNKS  25
+#define MAX_CHUNKS     10000
+
+typedef struct Feed {
+    /* write ends of the input pipes and read end of the output pipe */
+    int in[2];
+    int out;
+    int nb_chunks;
+    /* when each packet was written to each input */
+    atomic_int_least64_t written[2][MAX_CHUNKS];
+
+    int64_t total, worst;
+    int     nb;
+} Feed;
+
+static Feed feed;
+
+static void *feed_thread(void *arg)
+{
+    static const uint8_t chunk[CHUNK_SIZE];
+    Feed *f = arg;
+    int64_t next = av_gettime_relative();
+
+    for (int k = 0; k < f->nb_chunks; k++) {
+        for (int i = 0; i < 2; i++) {
+            atomic_store(&f->written[i][k], av_gettime_relative());
+            if (write(f->in[i], chunk, sizeof(chunk)) != sizeof(chunk))
+                goto end;
+        }
+        next += CHUNK_INTERVAL;
+        av_usleep(FFMAX(next - av_gettime_relative(), 0));
+    }
+end:
+    /* ends the inputs, and so the execution */
+    close(f->in[0]);
+    close(f->in[1]);
+    return NULL;
+}
+
+static void *read_thread(void *arg)
+{
+    Feed *f = arg;
+    FILE *out = fdopen(f->out, "r");
+    int tb_num[2] = { 1, 1 }, tb_den[2] = { SAMPLE_RATE, SAMPLE_RATE };
+    char line[256];
+
+    while (out && fgets(line, sizeof(line), out)) {
+        int64_t now = av_gettime_relative(), dts, pts, k, latency;
+        int st, num, den;
+
+        if (sscanf(line, "#tb %d: %d/%d", &st, &num, &den) == 3 &&
+            st >= 0 && st < 2 && num > 0 && den > 0) {
+            tb_num[st] = num;
+            tb_den[st] = den;
+            continue;
+        }
+        if (sscanf(line, "%d, %"SCNd64", %"SCNd64, &st, &dts, &pts) != 3 ||
+            st < 0 || st >= 2)
+            continue;
+
+        k = pts * tb_num[st] * SAMPLE_RATE / tb_den[st] / CHUNK_SAMPLES;
+        if (k < WARMUP_CHUNKS || k >= f->nb_chunks)
+            continue;
+        latency  = now - atomic_load(&f->written[st][k]);
+        f->total += latency;
+        f->worst  = FFMAX(f->worst, latency);
+        f->nb++;
+    }
+
+    if (out)
+        fclose(out);
+    else
+        close(f->out);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    FFToolsConfig config;
+    pthread_t feeder, reader;
+    char input[2][32], output[32];
+    char *ffmpeg_argv[] = {
+        "ffmpeg", "-hide_banner", "-nostdin",
+        "-f", "s16le", "-ar", "8000", "-ac", "1", "-i", input[0],
+        "-f", "s16le", "-ar", "8000", "-ac", "1", "-i", input[1],
+        "-map", "0:a", "-map", "1:a", "-c", "copy",
+        "-flush_packets", "1", "-f", "framecrc", output, NULL
+    };
+    int in[2][2], out[2];
+    int ret;
+
+    signal(SIGPIPE, SIG_IGN);
+    feed.nb_chunks = FFMIN(bench_count(argc, argv, 150) + WARMUP_CHUNKS, MAX_CHUNKS);
+
+    if (pipe(in[0]) < 0 || pipe(in[1]) < 0 || pipe(out) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    feed.in[0] = in[0][1];
+    feed.in[1] = in[1][1];
+    feed.out   = out[0];
+    snprintf(input[0], sizeof(input[0]), "pipe:%d", in[0][0]);
+    snprintf(input[1], sizeof(input[1]), "pipe:%d", in[1][0]);
+    snprintf(output,   sizeof(output),   "pipe:%d", out[1]);
+
+    fftools_config_init(&config);
+    config.log_level = AV_LOG_ERROR;
+
+    pthread_create(&reader, NULL, read_thread, &feed);
+    pthread_create(&feeder, NULL, feed_thread, &feed);
+
+    ret = ffmpeg_execute_with_config(FF_ARRAY_ELEMS(ffmpeg_argv) - 1, ffmpeg_argv, &config);
+
+    /* an execution that failed early leaves the feeder failing to write */
+    close(in[0][0]);
+    close(in[1][0]);
+    pthread_join(feeder, NULL);
+    /* ends the output for the reader */
+    close(out[1]);
+    pthread_join(reader, NULL);
+
+    if (ret || !feed.nb) {
+        fprintf(stderr, "execution failed\n");
+        return 1;
+    }
+    bench_report("two live pipe inputs", "write to output", (double)feed.total / feed.nb, "us");
+    bench_report("two live pipe inputs", "write to output, worst", feed.worst, "us");
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "libavutil/macros.h"
+#include "libavutil/time.h"
+
+#include "bench.h"
+#include "fftools_api.h"
+
+/*
+ * Cost per log line of formatting and delivering the output of ffmpeg
+ * -loglevel debug -debug_ts, which logs several lines per packet. The same
+ * execution run with -loglevel quiet, where lines are dropped before being
+ * formatted, is subtracted.
+ *
+ * usage: bench_log_format [frames]
+ */
+
+static void count_line(int level, char *message, void *user_data)
+{
+    (*(int64_t *)user_data)++;
+}
+
+static void count_batch(const FFToolsLogRecord *records, int nb_records, void *user_data)
+{
+    *(int64_t *)user_data += nb_records;
+}
+
+/* @return the duration of the execution in microseconds, -1 on failure */
+static int64_t run(const char *loglevel, int structured, int nb_frames, int64_t *nb_lines)
+{
+    FFToolsConfig config;
+    char frames[16];
+    char *argv[] = {
+        "ffmpeg", "-hide_banner", "-nostats", "-loglevel", (char *)loglevel,
+        "-debug_ts", "-f", "lavfi", "-i", "testsrc=size=32x32:rate=25",
+        "-frames:v", frames, "-f", "null", "-", NULL
+    };
+    int64_t start;
+
+    fftools_config_init(&config);
+    config.user_data = nb_lines;
+    if (structured) {
+        config.log_batch_callback = count_batch;
+        config.structured_log     = 1;
+    } else {
+        config.log_callback       = count_line;
+    }
+    snprintf(frames, sizeof(frames), "%d", nb_frames);
+
+    *nb_lines = 0;
+    start = av_gettime_relative();
+    if (ffmpeg_execute_with_config(FF_ARRAY_ELEMS(argv) - 1, argv, &config))
+        return -1;
+    return av_gettime_relative() - start;
+}
+
+static void bench_log(const char *name, int structured, int nb_frames)
+{
+    int64_t nb_lines, nb_quiet;
+    int64_t quiet = run("quiet", structured, nb_frames, &nb_quiet);
+    int64_t debug = run("debug", structured, nb_frames, &nb_lines);
+
+    if (quiet < 0 || debug < 0) {
+        fprintf(stderr, "%s: execution failed\n", name);
+        return;
+    }
+    bench_report(name, "lines", nb_lines, "");
+    if (nb_lines > nb_quiet)
+        bench_report(name, "per line", (debug - quiet) * 1000.0 / (nb_lines - nb_quiet), "ns");
+}
+
+int main(int argc, char **argv)
+{
+    int nb_frames = bench_count(argc, argv, 2000);
+
+    bench_log("log_callback", 0, nb_frames);
+    bench_log("log_batch_callback, structured", 1, nb_frames);
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "libavutil/macros.h"
+#include "libavutil/time.h"
+
+#include "bench.h"
+#include "fftools_api.h"
+
+/*
+ * AVPacket allocations of the demuxer thread per packet demuxed, taken from
+ * the execution summary. Before the packet pool every packet was allocated,
+ * so the packet count is the allocation count it replaced.
+ *
+ * usage: bench_packet_allocs [seconds of audio per input]
+ */
+
+typedef struct Counts {
+    uint64_t packets;
+    uint64_t packet_allocs;
+} Counts;
+
+static void count_allocs(const FFToolsSessionSummary *summary, void *user_data)
+{
+    Counts *counts = user_data;
+
+    for (int i = 0; i < summary->nb_inputs; i++) {
+        counts->packets       += summary->inputs[i].packets;
+        counts->packet_allocs += summary->inputs[i].packet_allocs;
+    }
+}
+
+static void bench_allocs(const char *name, int nb_inputs, int duration)
+{
+    FFToolsConfig config;
+    Counts counts = { 0 };
+    char source[64];
+    char *argv[24];
+    int argc = 0;
+    int64_t start, elapsed;
+
+    /* small frames, so that there are many packets */
+    snprintf(source, sizeof(source), "sine=d=%d:samples_per_frame=256", duration);
+    argv[argc++] = "ffmpeg";
+    argv[argc++] = "-hide_banner";
+    for (int i = 0; i < nb_inputs; i++) {
+        argv[argc++] = "-f";
+        argv[argc++] = "lavfi";
+        argv[argc++] = "-i";
+        argv[argc++] = source;
+    }
+    for (int i = 0; i < nb_inputs; i++) {
+        argv[argc++] = "-map";
+        argv[argc++] = i ? "1" : "0";
+    }
+    argv[argc++] = "-f";
+    argv[argc++] = "null";
+    argv[argc++] = "-";
+    argv[argc]   = NULL;
+
+    fftools_config_init(&config);
+    config.log_level        = AV_LOG_QUIET;
+    config.summary_callback = count_allocs;
+    config.user_data        = &counts;
+
+    start = av_gettime_relative();
+    if (ffmpeg_execute_with_config(argc, argv, &config) || !counts.packets) {
+        fprintf(stderr, "%s: execution failed\n", name);
+        return;
+    }
+    elapsed = av_gettime_relative() - start;
+
+    bench_report(name, "packets", counts.packets, "");
+    bench_report(name, "allocations without pool", counts.packets, "");
+    bench_report(name, "allocations with pool", counts.packet_allocs, "");
+    bench_report(name, "allocations per packet", (double)counts.packet_allocs / counts.packets, "");
+    bench_report_rate(name, "packets", counts.packets, elapsed);
+}
+
+int main(int argc, char **argv)
+{
+    int duration = bench_count(argc, argv, 600);
+
+    bench_allocs("one lavfi input", 1, duration);
+    bench_allocs("two lavfi inputs", 2, duration);
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "bench.h"
+#include "objpool.h"
+#include "ring_queue.h"
+#include "thread_queue.h"
+
+/*
+ * Messages per second through RingQueue and through ThreadQueue, from one or
+ * more sender threads to one receiver.
+ *
+ * usage: bench_queue_throughput [messages per sender]
+ */
+
+#define MAX_SENDERS 4
+
+typedef struct Msg {
+    int64_t seq;
+    int64_t payload;
+} Msg;
+
+typedef struct Sender {
+    RingQueue   *rq;
+    ThreadQueue *tq;
+    /* stream of the ThreadQueue this sender finishes */
+    int          idx;
+    int64_t      nb;
+} Sender;
+
+static void *msg_alloc(void)
+{
+    return av_mallocz(sizeof(Msg));
+}
+
+static void msg_reset(void *obj)
+{
+    memset(obj, 0, sizeof(Msg));
+}
+
+static void msg_free(void **obj)
+{
+    av_freep(obj);
+}
+
+static void msg_move(void *dst, void *src)
+{
+    memcpy(dst, src, sizeof(Msg));
+    msg_reset(src);
+}
+
+static void *sender_thread(void *arg)
+{
+    Sender *s = arg;
+    Msg msg = { 0 };
+
+    for (int64_t i = 0; i < s->nb; i++) {
+        int ret;
+
+        msg.seq = i;
+        ret = s->rq ? rq_send(s->rq, &msg) : tq_send(s->tq, s->idx, &msg);
+        if (ret < 0)
+            break;
+    }
+    if (s->tq)
+        tq_send_finish(s->tq, s->idx);
+
+    return NULL;
+}
+
+/* receive on the calling thread until every message sent has arrived */
+static void bench_queue(const char *name, int use_rq, int capacity,
+                        int nb_senders, int64_t nb)
+{
+    Sender    senders[MAX_SENDERS];
+    pthread_t threads[MAX_SENDERS];
+    RingQueue   *rq = NULL;
+    ThreadQueue *tq = NULL;
+    int64_t start, received = 0;
+    int nb_started = 0;
+
+    if (use_rq) {
+        rq = rq_alloc(capacity, sizeof(Msg), NULL);
+    } else {
+        ObjPool *op = objpool_alloc(msg_alloc, msg_reset, msg_free);
+        tq = op ? tq_alloc(nb_senders, capacity, op, msg_move) : NULL;
+        if (op && !tq)
+            objpool_free(&op);
+    }
+    if (!rq && !tq) {
+        fprintf(stderr, "%s: could not allocate the queue\n", name);
+        return;
+    }
+
+    start = av_gettime_relative();
+    for (int i = 0; i < nb_senders; i++) {
+        senders[i] = (Sender){ .rq = rq, .tq = tq, .idx = i, .nb = nb };
+        if (pthread_create(&threads[i], NULL, sender_thread, &senders[i]))
+            break;
+        nb_started++;
+    }
+
+    while (received < nb_started * nb) {
+        Msg msg;
+        int ret;
+
+        if (rq) {
+            ret = rq_receive(rq, &msg);
+        } else {
+            int stream_idx;
+
+            ret = tq_receive(tq, &stream_idx, &msg);
+            /* a sender finished */
+            if (ret == AVERROR_EOF && stream_idx >= 0)
+                continue;
+        }
+        if (ret < 0)
+            break;
+        received++;
+    }
+
+    bench_report_rate(name, "messages", received, av_gettime_relative() - start);
+
+    if (rq)
+        rq_receive_finish(rq);
+    else
+        for (int i = 0; i < nb_senders; i++)
+            tq_receive_finish(tq, i);
+    for (int i = 0; i < nb_started; i++)
+        pthread_join(threads[i], NULL);
+
+    rq_free(&rq);
+    tq_free(&tq);
+}
+
+int main(int argc, char **argv)
+{
+    int64_t nb = bench_count(argc, argv, 1000000);
+    static const int capacities[] = { 8, 256 };
+    static const int nb_senders[] = { 1, MAX_SENDERS };
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(capacities); i++) {
+        for (int j = 0; j < FF_ARRAY_ELEMS(nb_senders); j++) {
+            char name[64];
+
+            snprintf(name, sizeof(name), "RingQueue, %d items, %d sender%s",
+                     capacities[i], nb_senders[j], nb_senders[j] > 1 ? "s" : "");
+            bench_queue(name, 1, capacities[i], nb_senders[j], nb);
+
+            snprintf(name, sizeof(name), "ThreadQueue, %d items, %d sender%s",
+                     capacities[i], nb_senders[j], nb_senders[j] > 1 ? "s" : "");
+            bench_queue(name, 0, capacities[i], nb_senders[j], nb);
+        }
+    }
+
+    return 0;
+}
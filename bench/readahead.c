@@ -0,0 +1,124 @@
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "libavutil/macros.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "bench.h"
+#include "fftools_api.h"
+
+/*
+ * Encoding raw video read from a throttled pipe, with and without
+ * -readahead. The feeder behaves like storage with a fixed latency per
+ * request: it writes one block, then waits before serving the next, so a
+ * reader that only reads when the demuxer asks pays the latency on top of
+ * encoding, while the read-ahead thread overlaps the two.
+ *
+ * usage: bench_readahead [frames]
+ */
+
+#define WIDTH      320
+#define HEIGHT     240
+#define FRAME_SIZE (WIDTH * HEIGHT * 3 / 2)
+#define BLOCK_SIZE (64 * 1024)
+
+typedef struct Feed {
+    int     fd;
+    int64_t size;
+    /* wait after every block, in microseconds */
+    int     latency;
+} Feed;
+
+static void *feed_thread(void *arg)
+{
+    static const uint8_t block[BLOCK_SIZE];
+    Feed *f = arg;
+
+    for (int64_t written = 0; written < f->size; ) {
+        int len = FFMIN(f->size - written, BLOCK_SIZE);
+
+        if (write(f->fd, block, len) != len)
+            break;
+        written += len;
+        if (f->latency)
+            av_usleep(f->latency);
+    }
+    close(f->fd);
+    return NULL;
+}
+
+/* @return the duration of the execution in microseconds, -1 on failure */
+static int64_t run(const char *readahead, int latency, int nb_frames)
+{
+    FFToolsConfig config;
+    pthread_t feeder;
+    Feed feed;
+    char input[32], frames[16];
+    char *argv[] = {
+        "ffmpeg", "-hide_banner", "-nostdin", "-readahead", (char *)readahead,
+        "-f", "rawvideo", "-pix_fmt", "yuv420p", "-video_size", "320x240",
+        "-framerate", "25", "-i", input, "-frames:v", frames, "-c:v", "mpeg4",
+        "-f", "null", "-", NULL
+    };
+    int64_t start, elapsed;
+    int fds[2], ret;
+
+    if (pipe(fds) < 0)
+        return -1;
+    feed.fd      = fds[1];
+    feed.size    = (int64_t)nb_frames * FRAME_SIZE;
+    feed.latency = latency;
+    snprintf(input, sizeof(input), "pipe:%d", fds[0]);
+    snprintf(frames, sizeof(frames), "%d", nb_frames);
+
+    fftools_config_init(&config);
+    config.log_level = AV_LOG_QUIET;
+
+    if (pthread_create(&feeder, NULL, feed_thread, &feed)) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    start   = av_gettime_relative();
+    ret     = ffmpeg_execute_with_config(FF_ARRAY_ELEMS(argv) - 1, argv, &config);
+    elapsed = av_gettime_relative() - start;
+
+    /* an execution that failed early leaves the feeder failing to write */
+    close(fds[0]);
+    pthread_join(feeder, NULL);
+
+    return ret ? -1 : elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    int nb_frames = bench_count(argc, argv, 500);
+    static const struct {
+        const char *name;
+        const char *readahead;
+        int         latency;
+    } cases[] = {
+        { "pipe",                         "0",       0    },
+        { "pipe, -readahead",             "4194304", 0    },
+        { "throttled pipe",               "0",       2000 },
+        { "throttled pipe, -readahead",   "4194304", 2000 },
+    };
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(cases); i++) {
+        int64_t elapsed = run(cases[i].readahead, cases[i].latency, nb_frames);
+
+        if (elapsed < 0) {
+            fprintf(stderr, "%s: execution failed\n", cases[i].name);
+            continue;
+        }
+        bench_report(cases[i].name, "time", elapsed / 1000.0, "ms");
+        bench_report_rate(cases[i].name, "frames", nb_frames, elapsed);
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "libavutil/cpu.h"
+#include "libavutil/macros.h"
+#include "libavutil/time.h"
+
+#include "bench.h"
+#include "fftools_api.h"
+
+/*
+ * Aggregate throughput of 1 to 32 concurrent executions each encoding the
+ * same lavfi clip, with codec threads shared through the thread budget and
+ * with every execution asking for one thread per core.
+ *
+ * usage: bench_session_scaling [frames per execution]
+ */
+
+#define MAX_SESSIONS 32
+
+/* @return the time all executions took in microseconds, -1 on failure */
+static int64_t run(int nb_sessions, int nb_frames, int threads)
+{
+    FFToolsSession *sessions[MAX_SESSIONS];
+    FFToolsConfig config;
+    char frames[16], nb_threads[16];
+    char *argv[16];
+    int argc = 0;
+    int64_t start;
+    int nb_started = 0, failed = 0;
+
+    snprintf(frames, sizeof(frames), "%d", nb_frames);
+    snprintf(nb_threads, sizeof(nb_threads), "%d", threads);
+    argv[argc++] = "ffmpeg";
+    argv[argc++] = "-hide_banner";
+    argv[argc++] = "-f";
+    argv[argc++] = "lavfi";
+    argv[argc++] = "-i";
+    argv[argc++] = "testsrc=size=640x360:rate=25";
+    argv[argc++] = "-frames:v";
+    argv[argc++] = frames;
+    argv[argc++] = "-c:v";
+    argv[argc++] = "mpeg4";
+    /* left out when sharing the budget */
+    if (threads) {
+        argv[argc++] = "-threads";
+        argv[argc++] = nb_threads;
+    }
+    argv[argc++] = "-f";
+    argv[argc++] = "null";
+    argv[argc++] = "-";
+    argv[argc]   = NULL;
+
+    fftools_config_init(&config);
+    config.log_level = AV_LOG_QUIET;
+
+    start = av_gettime_relative();
+    for (int i = 0; i < nb_sessions; i++) {
+        if (ffmpeg_submit_with_config(argc, argv, &config, &sessions[i]) < 0)
+            break;
+        nb_started++;
+    }
+    for (int i = 0; i < nb_started; i++)
+        failed |= fftools_session_join(sessions[i]) != 0;
+
+    return nb_started == nb_sessions && !failed ? av_gettime_relative() - start : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int nb_frames = bench_count(argc, argv, 250);
+    int nb_cores  = av_cpu_count();
+
+    for (int threads = 0; threads <= 1; threads++) {
+        for (int nb_sessions = 1; nb_sessions <= MAX_SESSIONS; nb_sessions *= 2) {
+            char name[64];
+            int64_t elapsed = run(nb_sessions, nb_frames, threads ? nb_cores : 0);
+
+            snprintf(name, sizeof(name), "%d session%s, %s", nb_sessions,
+                     nb_sessions > 1 ? "s" : "",
+                     threads ? "-threads per core" : "shared budget");
+            if (elapsed < 0) {
+                fprintf(stderr, "%s: execution failed\n", name);
+                continue;
+            }
+            bench_report_rate(name, "frames", (int64_t)nb_sessions * nb_frames, elapsed);
+        }
+    }
+
+    return 0;
+}
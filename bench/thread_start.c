@@ -0,0 +1,115 @@
+#include <stdint.h>
+
+#include "libavutil/macros.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "bench.h"
+#include "fftools_api.h"
+#include "thread_pool.h"
+
+/*
+ * Cost of starting an execution on a new thread versus a parked pool worker.
+ *
+ * usage: bench_thread_start [iterations]
+ */
+
+typedef struct StartState {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    /* when the job started running, 0 until then */
+    int64_t         started;
+} StartState;
+
+static void start_job(void *arg)
+{
+    StartState *st = arg;
+    int64_t now = av_gettime_relative();
+
+    pthread_mutex_lock(&st->lock);
+    st->started = now;
+    pthread_cond_signal(&st->cond);
+    pthread_mutex_unlock(&st->lock);
+}
+
+/* time from tp_submit() until the job runs, one job at a time */
+static void bench_pool(const char *name, unsigned int max_idle, int nb)
+{
+    ThreadPool *tp = tp_alloc(max_idle);
+    StartState st = { .started = 0 };
+    int64_t total = 0, worst = 0;
+    int i;
+
+    if (!tp) {
+        fprintf(stderr, "%s: could not allocate the pool\n", name);
+        return;
+    }
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.cond, NULL);
+
+    for (i = 0; i < nb; i++) {
+        int64_t start, delay;
+
+        st.started = 0;
+        start = av_gettime_relative();
+        if (tp_submit(tp, start_job, &st) < 0) {
+            fprintf(stderr, "%s: could not submit job %d\n", name, i);
+            break;
+        }
+
+        pthread_mutex_lock(&st.lock);
+        while (!st.started)
+            pthread_cond_wait(&st.cond, &st.lock);
+        delay = st.started - start;
+        pthread_mutex_unlock(&st.lock);
+
+        total += delay;
+        worst  = FFMAX(worst, delay);
+    }
+
+    tp_free(&tp);
+    pthread_cond_destroy(&st.cond);
+    pthread_mutex_destroy(&st.lock);
+
+    if (i) {
+        bench_report(name, "submit to start", (double)total / i, "us");
+        bench_report(name, "submit to start, worst", worst, "us");
+    }
+}
+
+/* whole executions doing next to nothing, so that starting them dominates */
+static void bench_execute(const char *name, unsigned int max_idle, int nb)
+{
+    FFToolsConfig config;
+    int64_t start;
+    int i;
+
+    fftools_config_init(&config);
+    config.log_level = AV_LOG_QUIET;
+    fftools_set_max_idle_threads(max_idle);
+
+    start = av_gettime_relative();
+    for (i = 0; i < nb; i++) {
+        char *argv[] = { "ffmpeg", "-hide_banner", "-version", NULL };
+
+        if (ffmpeg_execute_with_config(FF_ARRAY_ELEMS(argv) - 1, argv, &config)) {
+            fprintf(stderr, "%s: execution %d failed\n", name, i);
+            break;
+        }
+    }
+    if (i)
+        bench_report(name, "execution", (double)(av_gettime_relative() - start) / i, "us");
+}
+
+int main(int argc, char **argv)
+{
+    int nb = bench_count(argc, argv, 2000);
+
+    bench_pool("pool, new thread per job", 0, nb);
+    bench_pool("pool, parked worker", 1, nb);
+
+    bench_execute("ffmpeg -version, new thread", 0, nb / 10 + 1);
+    bench_execute("ffmpeg -version, pooled", 1, nb / 10 + 1);
+
+    return 0;
+}
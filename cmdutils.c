@@ -84,6 +84,13 @@ void init_dynload(void)
 
 static __thread void (*program_exit)(int ret);
 
+void cmdutils_var_cleanup(void)
+{
+    program_exit = NULL;
+    hide_banner = 0;
+    longjmp_value = 0;
+}
+
 void register_exit(void (*cb)(int ret))
 {
     program_exit = cb;
@@ -534,7 +541,7 @@ int opt_default(void *optctx, const char *opt, const char *arg)
 #endif
 
     if (!strcmp(opt, "debug") || !strcmp(opt, "fdebug"))
-        av_log_set_level(AV_LOG_DEBUG);
+        fftools_set_log_level(AV_LOG_DEBUG);
 
     if (!(p = strchr(opt, ':')))
         p = opt + strlen(opt);
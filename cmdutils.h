@@ -54,6 +54,12 @@ extern __thread AVDictionary *format_opts, *codec_opts;
 extern __thread int hide_banner;
 extern __thread int find_stream_info;
 
+/**
+ * Reset the cmdutils thread-local state to its defaults, so a pooled worker
+ * thread starts each job in the same state as a freshly created one.
+ */
+void cmdutils_var_cleanup(void);
+
 /**
  * Register a program-specific cleanup routine.
  */
@@ -19,5 +19,10 @@
 #elif __APPLE__ || __ANDROID__ || __linux__ || __unix__ || defined(_POSIX_VERSION)
     #define HAVE_PTHREADS 1
 #endif
+#if __APPLE__ || __ANDROID__ || __linux__ || __unix__ || defined(_POSIX_VERSION)
+    #define HAVE_POLL_H 1
+#else
+    #define HAVE_POLL_H 0
+#endif
 #define HAVE_THREADS 1
 #endif /* FFMPEG_CONFIG_H */
@@ -1,117 +1,327 @@
+#include <sched.h>
+#include <stdatomic.h>
+
 #include "dart_api.h"
 #include "dart_api_types.h"
 #include "fftools.h"
 #include "fftools_api.h"
+#include "job_scheduler.h"
+#include "libavutil/cpu.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
 #include "libavutil/thread.h"
 
 static Dart_PostCObject post_c_object_ = NULL;
-static pthread_mutex_t* lock;
 
-struct node {
-	Dart_Port port;
-	FFToolsSession* session;
-	struct node* next;
-};
+/** Sessions registered at once at most, a power of two; sessions beyond cannot be cancelled */
+#define FFTOOLS_FFI_MAX_SESSIONS 4096
+
+/**
+ * One entry of the open-addressing table mapping send ports to sessions.
+ * A job holds its slot from its submission until it returns, so that a
+ * cancel arriving before the job registered its session is not lost.
+ * A released slot keeps its port, so lookups keep probing past it, and is
+ * reused by a later submission. Submissions take the first unused slot, so
+ * no port ends up further from its hash slot than the jobs held at once, and
+ * lookups stop after max_probe slots.
+ */
+typedef struct SessionSlot {
+	atomic_int_least64_t port;
+	/** Whether a job holds the slot */
+	atomic_int used;
+	_Atomic(FFToolsSession*) session;
+	/** Set by a cancel, for the session registered afterwards */
+	atomic_int cancelled;
+	/** Lookups reading the slot; it is reused and its session dropped only without any */
+	atomic_int readers;
+} SessionSlot;
+
+static SessionSlot sessions[FFTOOLS_FFI_MAX_SESSIONS];
+/** Largest distance of a held port from its hash slot so far */
+static atomic_size_t max_probe;
+/** Serializes reserving slots, lookups take no lock */
+static pthread_mutex_t sessions_lock;
+static AVOnce sessions_lock_once = AV_ONCE_INIT;
+
+static void sessions_lock_init(void) {
+	pthread_mutex_init(&sessions_lock, NULL);
+}
+
+/** Queues the executions, running as many at once as there are cores by default */
+static JobScheduler* scheduler;
+static AVOnce scheduler_once = AV_ONCE_INIT;
+
+static void scheduler_init(void) {
+	ThreadPool* tp = fftools_thread_pool();
+	scheduler = tp ? js_alloc(tp, av_cpu_count()) : NULL;
+}
+
+static JobScheduler* get_scheduler(void) {
+	ff_thread_once(&scheduler_once, scheduler_init);
+	return scheduler;
+}
+
+static size_t port_slot(Dart_Port port) {
+	uint64_t h = (uint64_t)port;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h & (FFTOOLS_FFI_MAX_SESSIONS - 1);
+}
+
+/** Holds a slot for the job submitted with port, returns NULL if the table is full */
+static SessionSlot* reserve_session(Dart_Port port) {
+	ff_thread_once(&sessions_lock_once, sessions_lock_init);
+	pthread_mutex_lock(&sessions_lock);
+	size_t start = port_slot(port);
+	for (size_t i = 0; i < FFTOOLS_FFI_MAX_SESSIONS; i++) {
+		SessionSlot* slot = &sessions[(start + i) & (FFTOOLS_FFI_MAX_SESSIONS - 1)];
+		// A lookup still reading the previous job could mark the new one cancelled
+		if (!atomic_load(&slot->used) && !atomic_load(&slot->readers)) {
+			if (i > atomic_load(&max_probe)) {
+				atomic_store(&max_probe, i);
+			}
+			// Publish the port first, lookups check it after seeing the slot used
+			atomic_store(&slot->port, port);
+			atomic_store(&slot->cancelled, 0);
+			atomic_store(&slot->used, 1);
+			pthread_mutex_unlock(&sessions_lock);
+			return slot;
+		}
+	}
+	pthread_mutex_unlock(&sessions_lock);
+	printf_stderr("Too many jobs to register send_port %lld, it cannot be cancelled once started\n", (long long)port);
+	return NULL;
+}
 
-struct node* head;
+static void store_session(SessionSlot* slot, FFToolsSession* session) {
+	if (!slot) {
+		return;
+	}
+	fftools_session_ref(session);
+	atomic_store(&slot->session, session);
+	// Pairs with cancel_session(): either it sees the session, or this sees its mark
+	if (atomic_load(&slot->cancelled)) {
+		fftools_session_cancel(session);
+	}
+}
 
-static void ensure_lock_created() {
-	if (lock) {
+static void remove_session(SessionSlot* slot) {
+	if (!slot) {
 		return;
 	}
-	lock = malloc(sizeof(pthread_mutex_t));
-	pthread_mutex_init(lock, NULL);
+	FFToolsSession* session = atomic_exchange(&slot->session, NULL);
+	atomic_store(&slot->used, 0);
+	if (session) {
+		// A lookup that read the session is about to take a reference
+		while (atomic_load(&slot->readers)) {
+			sched_yield();
+		}
+		fftools_session_unref(session);
+	}
 }
 
-static FFToolsSession* find_session(Dart_Port port) {
-	ensure_lock_created();
-	FFToolsSession* session = NULL;
-	pthread_mutex_lock(lock);
-	struct node* p = head;
-	while (p) {
-		if (p->port == port) {
-			session = p->session;
+/**
+ * Cancels the session of the job submitted with port, or marks the job so that
+ * its session is cancelled as soon as it is registered.
+ * Returns whether a job was found.
+ */
+static int cancel_session(Dart_Port port) {
+	size_t start = port_slot(port);
+	size_t probe = atomic_load(&max_probe);
+	for (size_t i = 0; i <= probe; i++) {
+		SessionSlot* slot = &sessions[(start + i) & (FFTOOLS_FFI_MAX_SESSIONS - 1)];
+		Dart_Port key = atomic_load(&slot->port);
+		if (!key) {
 			break;
 		}
-		p = p->next;
-	}
-	pthread_mutex_unlock(lock);
-	return session;
-}
-
-static void store_session(Dart_Port port, FFToolsSession* session) {
-	ensure_lock_created();
-	pthread_mutex_lock(lock);
-	struct node** to_p = &head;
-	while (*to_p) {
-		to_p = &(*to_p)->next;
-	}
-	*to_p = malloc(sizeof(struct node));
-	(*to_p)->next = NULL;
-	(*to_p)->port = port;
-	(*to_p)->session = session;
-	pthread_mutex_unlock(lock);
-}
-
-static void remove_session(Dart_Port port) {
-	ensure_lock_created();
-	pthread_mutex_lock(lock);
-	struct node** to_p = &head;
-	while (*to_p) {
-		if ((*to_p)->port == port) {
-			struct node* new_p = (*to_p)->next;
-			free(*to_p);
-			*to_p = new_p;
-			break;
+		if (key != port) {
+			continue;
+		}
+		int found = 0;
+		FFToolsSession* session = NULL;
+		atomic_fetch_add(&slot->readers, 1);
+		// The slot may have been released and reused for another port meanwhile
+		if (atomic_load(&slot->used) && atomic_load(&slot->port) == port) {
+			found = 1;
+			atomic_store(&slot->cancelled, 1);
+			session = atomic_load(&slot->session);
+			if (session) {
+				fftools_session_ref(session);
+			}
+		}
+		atomic_fetch_sub(&slot->readers, 1);
+		if (session) {
+			fftools_session_cancel(session);
+			fftools_session_unref(session);
+		}
+		if (found) {
+			return 1;
 		}
-		to_p = &(*to_p)->next;
 	}
-	pthread_mutex_unlock(lock);
+	return 0;
 }
 
+/** Largest number of log lines handed over at once, and how long to wait for more of them */
+#define FFTOOLS_FFI_LOG_BATCH_SIZE 256
+#define FFTOOLS_FFI_LOG_BATCH_LATENCY_MS 20
+
 typedef struct DartApiArg {
 	int64_t send_port;
+	/** Holds the session of the job for FFToolsCancel, NULL if the table was full */
+	SessionSlot* slot;
     int argc;
     char **argv;
+	/** Addresses of the messages waiting to be posted together */
+	int64_t* pending;
+	int nb_pending;
+	int max_pending;
 } DartApiArg;
 
 void FFToolsFFIInitialize(void* post_c_object) {
 	post_c_object_ = (Dart_PostCObject)post_c_object;
 }
 
-static void ffi_session_callback(FFToolsSession* session, void* user_data) {
-	store_session(*((Dart_Port*)user_data), session);
+/** Released messages kept for reuse at most, beyond which they are freed */
+#define FFTOOLS_FFI_MAX_POOLED_MESSAGES 4096
+
+static FFToolsMessage* message_pool;
+static int nb_pooled_messages;
+static pthread_mutex_t message_pool_lock;
+static AVOnce message_pool_once = AV_ONCE_INIT;
+
+static void message_pool_init(void) {
+	pthread_mutex_init(&message_pool_lock, NULL);
+}
+
+/** Fills messages with nb reused or newly allocated messages, returns how many could be had */
+static int acquire_messages(FFToolsMessage** messages, int nb) {
+	int i = 0;
+	ff_thread_once(&message_pool_once, message_pool_init);
+	pthread_mutex_lock(&message_pool_lock);
+	for (; i < nb && message_pool; i++) {
+		messages[i] = message_pool;
+		message_pool = message_pool->next;
+		nb_pooled_messages--;
+	}
+	pthread_mutex_unlock(&message_pool_lock);
+	for (; i < nb; i++) {
+		messages[i] = (FFToolsMessage*)malloc(sizeof(FFToolsMessage));
+		if (!messages[i]) {
+			break;
+		}
+	}
+	return i;
+}
+
+static FFToolsMessage* acquire_message(void) {
+	FFToolsMessage* message;
+	return acquire_messages(&message, 1) ? message : NULL;
+}
+
+void FFToolsReleaseMessages(FFToolsMessage** messages, int nb_messages) {
+	int i = 0;
+	for (int j = 0; j < nb_messages; j++) {
+		if (messages[j]->type == FFTOOLS_LOG_MESSAGE && messages[j]->data.log_val.message != messages[j]->text) {
+			free(messages[j]->data.log_val.message);
+		}
+	}
+	ff_thread_once(&message_pool_once, message_pool_init);
+	pthread_mutex_lock(&message_pool_lock);
+	for (; i < nb_messages && nb_pooled_messages < FFTOOLS_FFI_MAX_POOLED_MESSAGES; i++) {
+		messages[i]->next = message_pool;
+		message_pool = messages[i];
+		nb_pooled_messages++;
+	}
+	pthread_mutex_unlock(&message_pool_lock);
+	for (; i < nb_messages; i++) {
+		free(messages[i]);
+	}
 }
 
-static void ffi_log_callback(int level, char* log_message, void* user_data) {
-	if (!post_c_object_) {
-		printf_stderr("Got log callback [%d] without post_c_object_: %s\n", level, log_message);
+void FFToolsReleaseMessage(FFToolsMessage* message) {
+	FFToolsReleaseMessages(&message, 1);
+}
+
+static int queue_message(DartApiArg* dartArg, FFToolsMessage* message) {
+	if (dartArg->nb_pending == dartArg->max_pending) {
+		int max = dartArg->max_pending ? 2 * dartArg->max_pending : FFTOOLS_FFI_LOG_BATCH_SIZE + 2;
+		int64_t* pending = realloc(dartArg->pending, max * sizeof(*pending));
+		if (!pending) {
+			printf_stderr("Failed to queue message of type %d\n", message->type);
+			FFToolsReleaseMessage(message);
+			return 0;
+		}
+		dartArg->pending = pending;
+		dartArg->max_pending = max;
+	}
+	dartArg->pending[dartArg->nb_pending++] = (int64_t)(intptr_t)message;
+	return 1;
+}
+
+/**
+ * Posts the queued messages to the port at once, as an Int64List of their
+ * addresses, so that the isolate wakes up once per batch rather than per line.
+ */
+static void post_pending(DartApiArg* dartArg) {
+	if (!dartArg->nb_pending) {
 		return;
 	}
-	Dart_Port port = *((Dart_Port*)user_data);
-	FFToolsMessage *message = (FFToolsMessage*)malloc(sizeof(FFToolsMessage));
-	message->type = FFTOOLS_LOG_MESSAGE;
-	message->data.log_val.level = level;
-	message->data.log_val.message = strdup(log_message);
 	Dart_CObject object;
-	object.type = Dart_CObject_kInt64;
-	object.value.as_int64 = (int64_t)message;
-	int ret = post_c_object_(port, &object);
-	if (!ret) {
+	object.type = Dart_CObject_kTypedData;
+	object.value.as_typed_data.type = Dart_TypedData_kInt64;
+	object.value.as_typed_data.length = dartArg->nb_pending;
+	object.value.as_typed_data.values = (const uint8_t*)dartArg->pending;
+	if (!post_c_object_ || !post_c_object_(dartArg->send_port, &object)) {
 		// Send failed
-		printf_stderr("Failed to post_c_object_ for log with error %d\n", ret);
-		free(message->data.log_val.message);
-		free(message);
+		printf_stderr("Failed to post_c_object_ for %d messages\n", dartArg->nb_pending);
+		for (int i = 0; i < dartArg->nb_pending; i++) {
+			FFToolsReleaseMessage((FFToolsMessage*)(intptr_t)dartArg->pending[i]);
+		}
 	}
+	dartArg->nb_pending = 0;
+}
+
+static void ffi_session_callback(FFToolsSession* session, void* user_data) {
+	store_session(((DartApiArg*)user_data)->slot, session);
+}
+
+static void ffi_log_batch_callback(const FFToolsLogRecord* records, int nb_records, void* user_data) {
+	DartApiArg* dartArg = (DartApiArg*)user_data;
+	FFToolsMessage* messages[FFTOOLS_FFI_LOG_BATCH_SIZE];
+	int nb = acquire_messages(messages, FFMIN(nb_records, FFTOOLS_FFI_LOG_BATCH_SIZE));
+	for (int i = 0; i < nb; i++) {
+		FFToolsMessage* message = messages[i];
+		message->type = FFTOOLS_LOG_MESSAGE;
+		message->data.log_val.level = records[i].level;
+		char* text = message->text;
+		size_t length = records[i].length;
+		if (length >= sizeof(message->text)) {
+			text = malloc(length + 1);
+			if (!text) {
+				// Keep what fits
+				text = message->text;
+				length = sizeof(message->text) - 1;
+			}
+		}
+		memcpy(text, records[i].message, length);
+		text[length] = 0;
+		message->data.log_val.message = text;
+		queue_message(dartArg, message);
+	}
+	if (nb < nb_records) {
+		printf_stderr("Failed to allocate %d log messages\n", nb_records - nb);
+	}
+	post_pending(dartArg);
 }
 
 static void ffi_statistics_callback(int frameNumber, float fps, float quality, int64_t size, int time, double bitrate, double speed, void* user_data) {
-	if (!post_c_object_) {
-		printf_stderr("Got statistics callback without post_c_object_\n");
+	DartApiArg* dartArg = (DartApiArg*)user_data;
+	FFToolsMessage *message = acquire_message();
+	if (!message) {
+		printf_stderr("Failed to allocate statistics message\n");
 		return;
 	}
-	Dart_Port port = *((Dart_Port*)user_data);
-	FFToolsMessage *message = (FFToolsMessage*)malloc(sizeof(FFToolsMessage));
 	message->type = FFTOOLS_STATISTICS_MESSAGE;
 	message->data.stats_val.frameNumber = frameNumber;
 	message->data.stats_val.fps = fps;
@@ -120,89 +330,162 @@ static void ffi_statistics_callback(int frameNumber, float fps, float quality, i
 	message->data.stats_val.time = time;
 	message->data.stats_val.bitrate = bitrate;
 	message->data.stats_val.speed = speed;
+	queue_message(dartArg, message);
+	post_pending(dartArg);
+}
+
+static void free_output(void* isolate_callback_data, void* peer) {
+	av_free(peer);
+}
+
+/** Hands ffprobe's output to Dart as a Uint8List backed by the buffer itself, freed by the finalizer */
+static void ffi_output_callback(char* data, size_t size, void* user_data) {
+	DartApiArg* dartArg = (DartApiArg*)user_data;
+	post_pending(dartArg);
 	Dart_CObject object;
-	object.type = Dart_CObject_kInt64;
-	object.value.as_int64 = (int64_t)message;
-	int ret = post_c_object_(port, &object);
-	if (!ret) {
+	object.type = Dart_CObject_kExternalTypedData;
+	object.value.as_external_typed_data.type = Dart_TypedData_kUint8;
+	object.value.as_external_typed_data.length = size;
+	object.value.as_external_typed_data.data = (uint8_t*)data;
+	object.value.as_external_typed_data.peer = data;
+	object.value.as_external_typed_data.callback = free_output;
+	if (!post_c_object_ || !post_c_object_(dartArg->send_port, &object)) {
 		// Send failed
-		printf_stderr("Failed to post_c_object_ for stats with error %d\n", ret);
-		free(message);
+		printf_stderr("Failed to post_c_object_ for output of %zu bytes\n", size);
+		av_free(data);
 	}
 }
 
-static void* ffmpeg_thread_(void* arg) {
-	DartApiArg* dartArg = (DartApiArg*)arg;
-	int returnCode = ffmpeg_execute_with_callbacks(dartArg->argc, dartArg->argv, ffi_session_callback, ffi_log_callback, ffi_statistics_callback, &dartArg->send_port);
-	FFToolsMessage *message = (FFToolsMessage*)malloc(sizeof(FFToolsMessage));
+static void post_return_code(DartApiArg* dartArg, int returnCode) {
+	FFToolsMessage *message = acquire_message();
+	if (!message) {
+		printf_stderr("Failed to allocate return code %d message\n", returnCode);
+		return;
+	}
 	message->type = FFTOOLS_RETURN_CODE_MESSAGE;
 	message->data.returnCode = returnCode;
-	Dart_CObject object;
-	object.type = Dart_CObject_kInt64;
-	object.value.as_int64 = (int64_t)message;
-	int ret = post_c_object_(dartArg->send_port, &object);
-	if (!ret) {
-		// Send failed
-		printf_stderr("Failed to post_c_object_ for return code %d with error %d\n", returnCode, ret);
-		free(message);
-	}
-	remove_session(dartArg->send_port);
+	queue_message(dartArg, message);
+	post_pending(dartArg);
+}
+
+static void free_dart_api_arg(DartApiArg* dartArg) {
+	remove_session(dartArg->slot);
 	for (int i = 0; i < dartArg->argc; i++) {
 		free(dartArg->argv[i]);
 	}
 	free(dartArg->argv);
+	free(dartArg->pending);
 	free(dartArg);
-	return NULL;
 }
 
-void FFToolsFFIExecuteFFmpeg(int64_t send_port, int argc, char **argv) {
-	DartApiArg* arg = (DartApiArg*)malloc(sizeof(DartApiArg));
+static void init_config(FFToolsConfig* config, DartApiArg* dartArg) {
+	fftools_config_init(config);
+	config->session_callback = ffi_session_callback;
+	config->log_batch_callback = ffi_log_batch_callback;
+	config->log_batch_max_records = FFTOOLS_FFI_LOG_BATCH_SIZE;
+	config->log_batch_max_latency_ms = FFTOOLS_FFI_LOG_BATCH_LATENCY_MS;
+	config->statistics_callback = ffi_statistics_callback;
+	config->user_data = dartArg;
+}
+
+static void ffmpeg_job_(void* arg) {
+	DartApiArg* dartArg = (DartApiArg*)arg;
+	FFToolsConfig config;
+	init_config(&config, dartArg);
+	int returnCode = ffmpeg_execute_with_config(dartArg->argc, dartArg->argv, &config);
+	post_return_code(dartArg, returnCode);
+	free_dart_api_arg(dartArg);
+}
+
+/** Called instead of a job that was cancelled or failed to start while queued */
+static void cancel_job_(void* arg, int err) {
+	DartApiArg* dartArg = (DartApiArg*)arg;
+	// Report a cancelled job the way ffmpeg reports a cancelled execution
+	post_return_code(dartArg, err == AVERROR_EXIT ? 255 : err);
+	free_dart_api_arg(dartArg);
+}
+
+static void submit_job(int64_t send_port, int argc, char **argv, enum JobPriority priority, void (*job)(void* arg)) {
+	DartApiArg* arg = (DartApiArg*)calloc(1, sizeof(DartApiArg));
+	if (!arg) {
+		printf_stderr("Failed to allocate job for send_port %lld\n", (long long)send_port);
+		DartApiArg failed = { .send_port = send_port };
+		post_return_code(&failed, AVERROR(ENOMEM));
+		free(failed.pending);
+		for (int i = 0; i < argc; i++) {
+			free(argv[i]);
+		}
+		free(argv);
+		return;
+	}
 	arg->send_port = send_port;
+	arg->slot = reserve_session(send_port);
 	arg->argc = argc;
 	arg->argv = argv;
-	pthread_t thread;
-	pthread_create(&thread, NULL, ffmpeg_thread_, (void*)arg); // TODO: Check return value
+	JobScheduler* js = get_scheduler();
+	int ret = js ? js_submit(js, priority, send_port, job, cancel_job_, (void*)arg) : AVERROR(ENOMEM);
+	if (ret < 0) {
+		printf_stderr("Failed to queue job with error %d\n", ret);
+		post_return_code(arg, ret);
+		free_dart_api_arg(arg);
+	}
+}
+
+void FFToolsFFIExecuteFFmpeg(int64_t send_port, int argc, char **argv) {
+	submit_job(send_port, argc, argv, JS_PRIORITY_BACKGROUND, ffmpeg_job_);
 }
 
-static void* ffprobe_thread_(void* arg) {
+static void ffprobe_job_(void* arg) {
 	DartApiArg* dartArg = (DartApiArg*)arg;
-	int returnCode = ffprobe_execute_with_callbacks(dartArg->argc, dartArg->argv, ffi_session_callback, ffi_log_callback, &dartArg->send_port);
-	FFToolsMessage *message = (FFToolsMessage*)malloc(sizeof(FFToolsMessage));
-	message->type = FFTOOLS_RETURN_CODE_MESSAGE;
-	message->data.returnCode = returnCode;
-	Dart_CObject object;
-	object.type = Dart_CObject_kInt64;
-	object.value.as_int64 = (int64_t)message;
-	int ret = post_c_object_(dartArg->send_port, &object);
-	if (!ret) {
-		// Send failed
-		printf_stderr("Failed to post_c_object_ for return code %d with error %d\n", returnCode, ret);
-		free(message);
-	}
-	remove_session(dartArg->send_port);
-	for (int i = 0; i < dartArg->argc; i++) {
-		free(dartArg->argv[i]);
-	}
-	free(dartArg->argv);
-	free(dartArg);
-	return NULL;
+	FFToolsConfig config;
+	init_config(&config, dartArg);
+	config.output_callback = ffi_output_callback;
+	int returnCode = ffprobe_execute_with_config(dartArg->argc, dartArg->argv, &config);
+	post_return_code(dartArg, returnCode);
+	free_dart_api_arg(dartArg);
 }
 
 
 void FFToolsFFIExecuteFFprobe(int64_t send_port, int argc, char **argv) {
-	DartApiArg* arg = (DartApiArg*)malloc(sizeof(DartApiArg));
-	arg->send_port = send_port;
-	arg->argc = argc;
-	arg->argv = argv;
-	pthread_t thread;
-	pthread_create(&thread, NULL, ffprobe_thread_, (void*)arg); // TODO: Check return value
+	submit_job(send_port, argc, argv, JS_PRIORITY_INTERACTIVE, ffprobe_job_);
+}
+
+void FFToolsFFISetMaxIdleThreads(int max_idle) {
+	fftools_set_max_idle_threads(max_idle < 0 ? 0 : max_idle);
+}
+
+void FFToolsFFISetThreadBudget(int nb_threads) {
+	fftools_set_thread_budget(nb_threads < 0 ? 0 : nb_threads);
 }
 
 void FFToolsCancel(int64_t send_port) {
-	FFToolsSession* session = find_session(send_port);
-	if (!session) {
-		printf_stderr("Failed to find session for send_port %lld to cancel\n", send_port);
+	JobScheduler* js = get_scheduler();
+	if (js && js_cancel(js, send_port)) {
 		return;
 	}
-	session->cancel_requested = 1;
-}
\ No newline at end of file
+	// A job taken off the queue may not have registered its session yet
+	if (!cancel_session(send_port)) {
+		printf_stderr("Failed to find session for send_port %lld to cancel\n", send_port);
+	}
+}
+
+void FFToolsFFISetMaxConcurrentJobs(int max_jobs) {
+	JobScheduler* js = get_scheduler();
+	if (js) {
+		js_set_max_running(js, max_jobs < 0 ? 0 : max_jobs);
+	}
+}
+
+void FFToolsFFIGetSchedulerStats(FFToolsSchedulerStats* stats) {
+	JobSchedulerStats js_stats = { 0 };
+	JobScheduler* js = get_scheduler();
+	if (js) {
+		js_get_stats(js, &js_stats);
+	}
+	stats->running = js_stats.nb_running;
+	stats->queuedInteractive = js_stats.nb_queued[JS_PRIORITY_INTERACTIVE];
+	stats->queuedBackground = js_stats.nb_queued[JS_PRIORITY_BACKGROUND];
+	stats->started = js_stats.nb_started;
+	stats->totalWaitUs = js_stats.total_wait;
+	stats->maxWaitUs = js_stats.max_wait;
+}
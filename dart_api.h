@@ -15,6 +15,9 @@ enum FFToolsMessageType {
 	FFTOOLS_STATISTICS_MESSAGE = 2
 };
 
+/** Log text shorter than this is stored in the message itself */
+#define FFTOOLS_MESSAGE_INLINE_TEXT_SIZE 192
+
 typedef struct FFToolsMessage {
 	enum FFToolsMessageType type;
     union {
@@ -33,20 +36,72 @@ typedef struct FFToolsMessage {
             double speed;
         } stats_val;
     } data;
+	/** Backs log_val.message when the text is short enough */
+	char text[FFTOOLS_MESSAGE_INLINE_TEXT_SIZE];
+	/** Links released messages kept for reuse */
+	struct FFToolsMessage* next;
 } FFToolsMessage;
 
+typedef struct FFToolsSchedulerStats {
+	int32_t running;
+	int32_t queuedInteractive;
+	int32_t queuedBackground;
+	/** Executions started so far */
+	int64_t started;
+	/** Time the started executions spent queued */
+	int64_t totalWaitUs;
+	int64_t maxWaitUs;
+} FFToolsSchedulerStats;
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
 DLLEXPORT void FFToolsFFIInitialize(void* post_c_object);
 
+/**
+ * Executions are queued and run a limited number at once, ffprobe ones ahead
+ * of ffmpeg ones, each kind in the order submitted.
+ *
+ * Messages of an execution are posted to send_port in batches, each an
+ * Int64List of FFToolsMessage addresses in order, the return code coming
+ * last. The receiver hands every message back with FFToolsReleaseMessage()
+ * or FFToolsReleaseMessages() once done with it.
+ */
 DLLEXPORT void FFToolsFFIExecuteFFmpeg(int64_t send_port, int argc, char **argv);
 
+/**
+ * Same as FFToolsFFIExecuteFFmpeg(), except that the printed output arrives
+ * as a single Uint8List before the return code rather than as log messages.
+ */
 DLLEXPORT void FFToolsFFIExecuteFFprobe(int64_t send_port, int argc, char **argv);
 
+/**
+ * An execution still queued is dropped, posting return code 255 as a
+ * cancelled running execution does.
+ */
 DLLEXPORT void FFToolsCancel(int64_t send_port);
 
+/** Limit the executions running at once, 0 for no limit */
+DLLEXPORT void FFToolsFFISetMaxConcurrentJobs(int max_jobs);
+
+DLLEXPORT void FFToolsFFIGetSchedulerStats(FFToolsSchedulerStats* stats);
+
+DLLEXPORT void FFToolsFFISetMaxIdleThreads(int max_idle);
+
+/**
+ * Codec and filter threads shared by the running executions, 0 for the number
+ * of cores, see fftools_set_thread_budget().
+ */
+DLLEXPORT void FFToolsFFISetThreadBudget(int nb_threads);
+
+/**
+ * Return messages received from an execution, along with their log text, for
+ * reuse by later messages.
+ */
+DLLEXPORT void FFToolsReleaseMessage(FFToolsMessage* message);
+DLLEXPORT void FFToolsReleaseMessages(FFToolsMessage** messages, int nb_messages);
+
 #if defined(__cplusplus)
 }  // extern "C"
 #endif
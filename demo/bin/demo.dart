@@ -1,7 +1,9 @@
 import 'dart:async';
+import 'dart:convert';
 import 'dart:ffi';
 import 'dart:io';
 import 'dart:isolate';
+import 'dart:typed_data';
 
 import 'package:async/async.dart';
 import 'package:ffi/ffi.dart';
@@ -10,6 +12,17 @@ const _kFFToolsMessageTypeReturnCode = 0;
 const _kFFToolsMessageTypeLog = 1;
 const _kFFToolsMessageTypeStatistics = 2;
 
+/// Messages arrive in batches, as an Int64List of their addresses.
+Iterable<Pointer<FFToolsMessage>> _messages(dynamic data) sync* {
+  if (data is Int64List) {
+    for (final address in data) {
+      yield Pointer<FFToolsMessage>.fromAddress(address);
+    }
+  } else if (data is int) {
+    yield Pointer<FFToolsMessage>.fromAddress(data);
+  }
+}
+
 sealed class FFToolsMessage extends Struct {
   @Int32()
   external int type;
@@ -52,6 +65,7 @@ Future<(int, String)> ffprobe(List<String> args) {
 	final initialize = fftools.lookupFunction<Void Function(Pointer), void Function(Pointer)>('FFToolsFFIInitialize');
 	initialize(NativeApi.postCObject);
 	final ffprobe = fftools.lookupFunction<Void Function(Int64, Int, Pointer<Pointer<Utf8>>), void Function(int, int, Pointer<Pointer<Utf8>>)>('FFToolsFFIExecuteFFprobe');
+  final release = fftools.lookupFunction<Void Function(Pointer<FFToolsMessage>), void Function(Pointer<FFToolsMessage>)>('FFToolsReleaseMessage');
   // Not freeing this memory is intentional. FFToolsFFI will free it when done execution.
   final argv = malloc<Pointer<Utf8>>(args.length);
   for (int i = 0; i < args.length; i++) {
@@ -59,26 +73,27 @@ Future<(int, String)> ffprobe(List<String> args) {
   }
   final port = ReceivePort();
   const logLevel = 32;
-  final buffer = StringBuffer();
+  String output = '';
   port.listen((data) {
-    if (data is int) {
-      final messagePointer = Pointer<FFToolsMessage>.fromAddress(data);
+    if (data is Uint8List) {
+      // The printed output, in one piece
+      output = utf8.decode(data);
+      return;
+    }
+    for (final messagePointer in _messages(data)) {
       switch (messagePointer.ref.type) {
         case _kFFToolsMessageTypeReturnCode:
           port.close();
-          completer.complete((messagePointer.ref.data.returnCode, buffer.toString()));
+          completer.complete((messagePointer.ref.data.returnCode, output));
         case _kFFToolsMessageTypeLog:
           if (messagePointer.ref.data.log.level <= logLevel) {
-            buffer.write(messagePointer.ref.data.log.message.toDartString());
+            stderr.write(messagePointer.ref.data.log.message.toDartString());
           }
         case _kFFToolsMessageTypeStatistics:
           final stats = messagePointer.ref.data.statistics;
           print('Statistics frameNumber: ${stats.frameNumber}, fps: ${stats.fps}, quality: ${stats.quality}, size: ${stats.size}, time: ${stats.time}, bitrate: ${stats.bitrate}, speed: ${stats.speed}');
       }
-      if (messagePointer.ref.type == _kFFToolsMessageTypeLog) {
-        malloc.free(messagePointer.ref.data.log.message);
-      }
-      malloc.free(messagePointer);
+      release(messagePointer);
     }
   });
   ffprobe(port.sendPort.nativePort, args.length, argv);
@@ -90,6 +105,7 @@ CancelableOperation<(int, String)> ffmpeg(List<String> args) {
 	final initialize = fftools.lookupFunction<Void Function(Pointer), void Function(Pointer)>('FFToolsFFIInitialize');
   initialize(NativeApi.postCObject);
   final ffmpeg = fftools.lookupFunction<Void Function(Int64, Int, Pointer<Pointer<Utf8>>), void Function(int, int, Pointer<Pointer<Utf8>>)>('FFToolsFFIExecuteFFmpeg');
+  final release = fftools.lookupFunction<Void Function(Pointer<FFToolsMessage>), void Function(Pointer<FFToolsMessage>)>('FFToolsReleaseMessage');
   final cancel = fftools.lookupFunction<Void Function(Int64), void Function(int)>('FFToolsCancel');
   final port = ReceivePort();
   final completer = CancelableCompleter<(int, String)>(
@@ -105,8 +121,7 @@ CancelableOperation<(int, String)> ffmpeg(List<String> args) {
   const logLevel = 32;
   final buffer = StringBuffer();
   port.listen((data) {
-    if (data is int) {
-      final messagePointer = Pointer<FFToolsMessage>.fromAddress(data);
+    for (final messagePointer in _messages(data)) {
       switch (messagePointer.ref.type) {
         case _kFFToolsMessageTypeReturnCode:
           port.close();
@@ -120,10 +135,7 @@ CancelableOperation<(int, String)> ffmpeg(List<String> args) {
           final stats = messagePointer.ref.data.statistics;
           print('Statistics frameNumber: ${stats.frameNumber}, fps: ${stats.fps}, quality: ${stats.quality}, size: ${stats.size}, time: ${stats.time}, bitrate: ${stats.bitrate}, speed: ${stats.speed}');
       }
-      if (messagePointer.ref.type == _kFFToolsMessageTypeLog) {
-        malloc.free(messagePointer.ref.data.log.message);
-      }
-      malloc.free(messagePointer);
+      release(messagePointer);
     }
   });
   print('Executing ffmpeg');
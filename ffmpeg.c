@@ -174,9 +174,15 @@ __thread int        nb_filtergraphs;
 __thread int64_t last_time = -1;
 __thread int64_t keyboard_last_time = 0;
 __thread int first_report = 1;
+/* stream whose muxed packets count towards FFToolsConfig.stats_interval_frames */
+__thread OutputStream *report_ost = NULL;
+__thread uint64_t last_report_frames = 0;
+/* number of input signals before the inputs were last polled, see wait_for_input() */
+__thread unsigned input_seq = 0;
 __thread int qp_histogram[52];
 
 void (*report_callback)(int, float, float, int64_t, int, double, double) = NULL;
+void (*output_report_callback)(FFToolsOutputStatistics *, int, FFToolsInputStatistics *, int, int) = NULL;
 
 extern __thread int file_overwrite;
 extern __thread int no_file_overwrite;
@@ -589,10 +595,12 @@ int decode_interrupt_cb(void *ctx);
 
 int decode_interrupt_cb(void *ctx)
 {
-    return received_nb_signals > atomic_load(&transcode_init_done);
+    /* ctx is the session, libav may call this on its own threads */
+    return received_nb_signals > atomic_load(&transcode_init_done) ||
+           fftools_interrupt_callback(ctx);
 }
 
-__thread const AVIOInterruptCB int_cb = { decode_interrupt_cb, NULL };
+__thread AVIOInterruptCB int_cb = { decode_interrupt_cb, NULL };
 
 static void ffmpeg_cleanup(int ret)
 {
@@ -605,6 +613,7 @@ static void ffmpeg_cleanup(int ret)
 
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
+        fftools_unregister_log_context(fg->graph);
         avfilter_graph_free(&fg->graph);
         for (j = 0; j < fg->nb_inputs; j++) {
             InputFilter *ifilter = fg->inputs[j];
@@ -671,7 +680,7 @@ static void ffmpeg_cleanup(int ret)
     if (received_sigterm) {
         av_log(NULL, AV_LOG_INFO, "Exiting normally, received signal %d.\n",
                (int) received_sigterm);
-    } else if (session->cancel_requested) {
+    } else if (fftools_cancel_requested()) {
         av_log(NULL, AV_LOG_INFO, "Exiting normally, received cancel request.\n");
     } else if (ret && atomic_load(&transcode_init_done)) {
         av_log(NULL, AV_LOG_INFO, "Conversion failed!\n");
@@ -1394,6 +1403,7 @@ static void do_video_out(OutputFile *of,
 
     if (nb_frames_prev == 0 && ost->last_dropped) {
         nb_frames_drop++;
+        ost->nb_frames_drop++;
         av_log(ost, AV_LOG_VERBOSE,
                "*** dropping frame %"PRId64" at ts %"PRId64"\n",
                ost->vsync_frame_number, ost->last_frame->pts);
@@ -1402,9 +1412,11 @@ static void do_video_out(OutputFile *of,
         if (nb_frames > dts_error_threshold * 30) {
             av_log(ost, AV_LOG_ERROR, "%"PRId64" frame duplication too large, skipping\n", nb_frames - 1);
             nb_frames_drop++;
+            ost->nb_frames_drop++;
             return;
         }
         nb_frames_dup += nb_frames - (nb_frames_prev && ost->last_dropped) - (nb_frames > nb_frames_prev);
+        ost->nb_frames_dup += nb_frames - (nb_frames_prev && ost->last_dropped) - (nb_frames > nb_frames_prev);
         av_log(ost, AV_LOG_VERBOSE, "*** %"PRId64" dup!\n", nb_frames - 1);
         if (nb_frames_dup > dup_warning) {
             av_log(ost, AV_LOG_WARNING, "More than %"PRIu64" frames duplicated\n", dup_warning);
@@ -1554,7 +1566,7 @@ static void print_final_stats(int64_t total_size)
 
     for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
         AVCodecParameters *par = ost->st->codecpar;
-        const uint64_t s = ost->data_size_mux;
+        const uint64_t s = atomic_load(&ost->data_size_mux);
 
         switch (par->codec_type) {
             case AVMEDIA_TYPE_VIDEO:    video_size    += s; break;
@@ -1631,7 +1643,7 @@ static void print_final_stats(int64_t total_size)
             OutputStream *ost = of->streams[j];
             enum AVMediaType type = ost->st->codecpar->codec_type;
 
-            total_size    += ost->data_size_mux;
+            total_size    += atomic_load(&ost->data_size_mux);
             total_packets += atomic_load(&ost->packets_written);
 
             av_log(NULL, AV_LOG_VERBOSE, "  Output stream #%d:%d (%s): ",
@@ -1645,7 +1657,7 @@ static void print_final_stats(int64_t total_size)
             }
 
             av_log(NULL, AV_LOG_VERBOSE, "%"PRIu64" packets muxed (%"PRIu64" bytes); ",
-                   atomic_load(&ost->packets_written), ost->data_size_mux);
+                   atomic_load(&ost->packets_written), atomic_load(&ost->data_size_mux));
 
             av_log(NULL, AV_LOG_VERBOSE, "\n");
         }
@@ -1704,10 +1716,10 @@ static void forward_report(int is_last_report, int64_t timer_start, int64_t cur_
             fps = t > 1 ? frame_number / t : 0;
         }
 
-        // 5. calculate time
-        if (av_stream_get_end_pts(ost->st) != AV_NOPTS_VALUE)
-            pts = FFMAX(pts, av_rescale_q(av_stream_get_end_pts(ost->st),
-                                          ost->st->time_base, AV_TIME_BASE_Q));
+        // 5. calculate time, from what was last handed to the muxer rather
+        // than the muxer's own state, which its thread keeps changing
+        if (ost->last_mux_dts != AV_NOPTS_VALUE)
+            pts = FFMAX(pts, ost->last_mux_dts);
 
         vid = 1;
     }
@@ -1727,6 +1739,106 @@ static void forward_report(int is_last_report, int64_t timer_start, int64_t cur_
     }
 }
 
+static void forward_output_report(int is_last_report, int64_t timer_start, int64_t cur_time)
+{
+    FFToolsOutputStatistics *outputs;
+    FFToolsStreamStatistics *streams;
+    FFToolsInputStatistics  *inputs;
+    int nb_streams = 0;
+    float t = (cur_time-timer_start) / 1000000.0;
+
+    if (output_report_callback == NULL || !nb_output_files ||
+        (!session->output_statistics && !session->input_statistics))
+        return;
+
+    for (int i = 0; i < nb_output_files; i++)
+        nb_streams += output_files[i]->nb_streams;
+
+    // One allocation for all, the stream records following the output ones
+    // and the input records following those
+    outputs = av_mallocz(nb_output_files * sizeof(*outputs) + nb_streams * sizeof(*streams) +
+                         nb_input_files * sizeof(*inputs));
+    if (!outputs)
+        return;
+    streams = (FFToolsStreamStatistics *)(outputs + nb_output_files);
+    inputs  = (FFToolsInputStatistics *)(streams + nb_streams);
+
+    for (int i = 0; i < nb_input_files; i++)
+        ifile_statistics(input_files[i], &inputs[i]);
+
+    for (int i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+        FFToolsOutputStatistics *out = &outputs[i];
+        int64_t pts = AV_NOPTS_VALUE;
+
+        out->file_index = i;
+        out->size       = of_filesize(of);
+        out->nb_streams = of->nb_streams;
+        out->streams    = streams;
+
+        for (int j = 0; j < of->nb_streams; j++) {
+            OutputStream *ost = of->streams[j];
+            FFToolsStreamStatistics *st = &out->streams[j];
+            int64_t packets_written = atomic_load(&ost->packets_written);
+
+            st->file_index      = i;
+            st->stream_index    = j;
+            st->type            = ost->st->codecpar->codec_type;
+            st->frames_encoded  = ost->frames_encoded;
+            st->packets_written = packets_written;
+            st->size            = atomic_load(&ost->data_size_mux);
+            st->quality         = ost->enc_ctx ? ost->quality / (float) FF_QP2LAMBDA : -1;
+            st->frames_dup      = ost->nb_frames_dup;
+            st->frames_drop     = ost->nb_frames_drop + (is_last_report ? ost->last_dropped : 0);
+            st->time            = ost->last_mux_dts != AV_NOPTS_VALUE ? ost->last_mux_dts / 1000 : -1;
+            st->fps             = t > 1 ? (ost->enc_ctx ? ost->frames_encoded : packets_written) / t : 0;
+            st->speed           = t != 0.0 && st->time >= 0 ? st->time / 1000.0 / t : -1;
+
+            if (ost->last_mux_dts != AV_NOPTS_VALUE)
+                pts = pts == AV_NOPTS_VALUE ? ost->last_mux_dts : FFMAX(pts, ost->last_mux_dts);
+        }
+        streams += of->nb_streams;
+
+        out->time    = pts != AV_NOPTS_VALUE ? pts / 1000 : -1;
+        out->bitrate = pts != AV_NOPTS_VALUE && pts > 0 && out->size >= 0 ? out->size * 8 / (pts / 1000.0) : -1;
+        out->speed   = t != 0.0 && out->time >= 0 ? out->time / 1000.0 / t : -1;
+    }
+
+    // The callback takes ownership of the records
+    output_report_callback(outputs, nb_output_files, inputs, nb_input_files, is_last_report);
+}
+
+/**
+ * Whether the next report is due, after stats_period or the interval set for
+ * the session. Only reads counters, so it is cheap enough for every iteration.
+ */
+static int report_due(int64_t cur_time)
+{
+    int64_t period = session->stats_interval_ms > 0 ? session->stats_interval_ms * 1000LL : stats_period;
+
+    if (first_report)
+        return nb_output_dumped >= nb_output_files;
+
+    if (session->stats_interval_frames > 0) {
+        if (!report_ost) {
+            // Count the frames of the first video stream, or of the first stream
+            for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
+                if (!report_ost || (ost->st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+                                    report_ost->st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO))
+                    report_ost = ost;
+            }
+            if (!report_ost)
+                return 0;
+        }
+        if (atomic_load(&report_ost->packets_written) - last_report_frames >= session->stats_interval_frames)
+            return 1;
+        if (session->stats_interval_ms <= 0)
+            return 0;
+    }
+
+    return cur_time - last_time >= period;
+}
+
 static void print_report(int is_last_report, int64_t timer_start, int64_t cur_time)
 {
     AVBPrint buf, buf_script;
@@ -1744,13 +1856,15 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         if (last_time == -1) {
             last_time = cur_time;
         }
-        if (((cur_time - last_time) < stats_period && !first_report) ||
-            (first_report && nb_output_dumped < nb_output_files))
+        if (!report_due(cur_time))
             return;
         last_time = cur_time;
+        if (report_ost)
+            last_report_frames = atomic_load(&report_ost->packets_written);
     }
 
     forward_report(is_last_report, timer_start, cur_time);
+    forward_output_report(is_last_report, timer_start, cur_time);
 
     if (!print_stats && !is_last_report && !progress_avio)
         return;
@@ -1894,7 +2008,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
 
     if (print_stats || is_last_report) {
         const char end = is_last_report ? '\n' : '\r';
-        if (print_stats==1 && AV_LOG_INFO > av_log_get_level()) {
+        if (print_stats==1 && AV_LOG_INFO > fftools_get_log_level()) {
             printf_stderr("%s    %c", buf.str, end);
         } else
             av_log(NULL, AV_LOG_INFO, "%s    %c", buf.str, end);
@@ -2224,7 +2338,7 @@ static int ifilter_send_eof(InputFilter *ifilter, int64_t pts)
 
     if (ifilter->filter) {
         /* THIS VALIDATION IS REQUIRED TO COMPLETE CANCELLATION */
-        if (!received_sigterm && !session->cancel_requested) {
+        if (!received_sigterm && !fftools_cancel_requested()) {
             ret = av_buffersrc_close(ifilter->filter, pts, AV_BUFFERSRC_FLAG_PUSH);
         }
         if (ret < 0)
@@ -2972,6 +3086,9 @@ static int init_input_stream(InputStream *ist, char *error, int error_len)
         ist->dec_ctx->opaque                = ist;
         ist->dec_ctx->get_format            = get_format;
 
+        fftools_register_log_context(ist->dec_ctx);
+        fftools_register_log_context(ist);
+
         if (ist->dec_ctx->codec_id == AV_CODEC_ID_DVB_SUBTITLE &&
            (ist->decoding_needed & DECODING_FOR_OST)) {
             av_dict_set(&ist->decoder_opts, "compute_edt", "1", AV_DICT_DONT_OVERWRITE);
@@ -2984,7 +3101,7 @@ static int init_input_stream(InputStream *ist, char *error, int error_len)
         ist->dec_ctx->pkt_timebase = ist->st->time_base;
 
         if (!av_dict_get(ist->decoder_opts, "threads", NULL, 0))
-            av_dict_set(&ist->decoder_opts, "threads", "auto", 0);
+            av_dict_set_int(&ist->decoder_opts, "threads", fftools_thread_budget(), 0);
         /* Attached pics are sparse, therefore we would not want to delay their decoding till EOF. */
         if (ist->st->disposition & AV_DISPOSITION_ATTACHED_PIC)
             av_dict_set(&ist->decoder_opts, "threads", "1", 0);
@@ -3383,7 +3500,7 @@ static int init_output_stream(OutputStream *ost, AVFrame *frame,
             return ret;
 
         if (!av_dict_get(ost->encoder_opts, "threads", NULL, 0))
-            av_dict_set(&ost->encoder_opts, "threads", "auto", 0);
+            av_dict_set_int(&ost->encoder_opts, "threads", fftools_thread_budget(), 0);
 
         if (codec->capabilities & AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE) {
             ret = av_dict_set(&ost->encoder_opts, "flags", "+copy_opaque", AV_DICT_MULTIKEY);
@@ -3399,6 +3516,10 @@ static int init_output_stream(OutputStream *ost, AVFrame *frame,
             return ret;
         }
 
+        ost->enc_ctx->opaque = ost;
+        fftools_register_log_context(ost->enc_ctx);
+        fftools_register_log_context(ost);
+
         if ((ret = avcodec_open2(ost->enc_ctx, codec, &ost->encoder_opts)) < 0) {
             if (ret == AVERROR_EXPERIMENTAL)
                 abort_codec_experimental(codec, 1);
@@ -3695,8 +3816,8 @@ static int check_keyboard_interaction(int64_t cur_time)
         av_log(NULL, AV_LOG_INFO, "\n\n[q] command received. Exiting.\n\n");
         return AVERROR_EXIT;
     }
-    if (key == '+') av_log_set_level(av_log_get_level()+10);
-    if (key == '-') av_log_set_level(av_log_get_level()-10);
+    if (key == '+') fftools_set_log_level(fftools_get_log_level()+10);
+    if (key == '-') fftools_set_log_level(fftools_get_log_level()-10);
     if (key == 's') qp_hist     ^= 1;
     if (key == 'c' || key == 'C'){
         char buf[4096], target[64], command[256], arg[256] = {0};
@@ -3769,7 +3890,7 @@ static int check_keyboard_interaction(int64_t cur_time)
             if (ost->enc_ctx)
                 ost->enc_ctx->debug = debug;
         }
-        if(debug) av_log_set_level(AV_LOG_DEBUG);
+        if(debug) fftools_set_log_level(AV_LOG_DEBUG);
         printf_stderr("debug=%d\n", debug);
     }
     if (key == '?'){
@@ -3788,6 +3909,16 @@ static int check_keyboard_interaction(int64_t cur_time)
     return 0;
 }
 
+/*
+ * Wait for a demuxer thread to make input available after all inputs were
+ * found empty. Inputs throttled by -re or -readrate make no signal when they
+ * are due, so the wait is bounded.
+ */
+static void wait_for_input(void)
+{
+    fftools_input_wait(input_seq, 10000);
+}
+
 static int got_eagain(void)
 {
     for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost))
@@ -3799,6 +3930,8 @@ static int got_eagain(void)
 static void reset_eagain(void)
 {
     int i;
+    /* inputs are polled again from here on, see wait_for_input() */
+    input_seq = fftools_input_seq();
     for (i = 0; i < nb_input_files; i++)
         input_files[i]->eagain = 0;
     for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost))
@@ -4025,7 +4158,7 @@ static int process_input(int file_index)
     process_input_packet(ist, pkt, 0);
 
 discard_packet:
-    av_packet_free(&pkt);
+    ifile_release_packet(ifile, &pkt);
 
     return 0;
 }
@@ -4092,8 +4225,8 @@ static int transcode_step(void)
     ost = choose_output();
     if (!ost) {
         if (got_eagain()) {
+            wait_for_input();
             reset_eagain();
-            av_usleep(10000);
             return 0;
         }
         av_log(NULL, AV_LOG_VERBOSE, "No more inputs to read from, finishing.\n");
@@ -4190,7 +4323,7 @@ static int transcode(void)
 
     timer_start = av_gettime_relative();
 
-    while (!received_sigterm && !session->cancel_requested) {
+    while (!received_sigterm && !fftools_cancel_requested()) {
         int64_t cur_time= av_gettime_relative();
 
         /* if 'q' pressed, exits */
@@ -4306,16 +4439,26 @@ static int64_t getmaxrss(void)
 void ffmpeg_var_cleanup(void);
 
 void ffmpeg_var_cleanup() {
+    cmdutils_var_cleanup();
+    ffmpeg_opt_var_cleanup();
+
     main_ffmpeg_return_code = 0;
     longjmp_value = 0;
     received_sigterm = 0;
     received_nb_signals = 0;
+    int_cb.opaque = session;
     ffmpeg_exited = 0;
     copy_ts_first_pts = AV_NOPTS_VALUE;
+    atomic_store(&transcode_init_done, 0);
+#if HAVE_TERMIOS_H
+    restore_tty = 0;
+#endif
 
     nb_frames_dup = 0;
     dup_warning = 1000;
     nb_frames_drop = 0;
+    memset(decode_error_stat, 0, sizeof(decode_error_stat));
+    memset(qp_histogram, 0, sizeof(qp_histogram));
     nb_output_dumped = 0;
 
     progress_avio = NULL;
@@ -4332,6 +4475,9 @@ void ffmpeg_var_cleanup() {
     last_time = -1;
     keyboard_last_time = 0;
     first_report = 1;
+    report_ost = NULL;
+    last_report_frames = 0;
+    input_seq = 0;
     log_callback_report_print_prefix = 1;
 }
 
@@ -4340,6 +4486,13 @@ void set_report_callback(void (*callback)(int, float, float, int64_t, int, doubl
     report_callback = callback;
 }
 
+void set_output_report_callback(void (*callback)(FFToolsOutputStatistics *outputs, int nb_outputs,
+                                                 FFToolsInputStatistics *inputs, int nb_inputs,
+                                                 int is_last))
+{
+    output_report_callback = callback;
+}
+
 int ffmpeg_execute(int argc, char **argv)
 {
     char _program_name[] = "ffmpeg";
@@ -4540,6 +4693,12 @@ int ffmpeg_execute(int argc, char **argv)
         { "thread_queue_size", HAS_ARG | OPT_INT | OPT_OFFSET | OPT_EXPERT | OPT_INPUT | OPT_OUTPUT,
                                                                         { .off = OFFSET(thread_queue_size) },
             "set the maximum number of queued packets from the demuxer" },
+        { "read_wait",      HAS_ARG | OPT_STRING | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
+                                                                        { .off = OFFSET(read_wait) },
+            "how to wait for input that is not ready: adaptive, backoff or sleep", "mode" },
+        { "readahead",      HAS_ARG | OPT_INT64 | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
+                                                                        { .off = OFFSET(readahead) },
+            "read local inputs this many bytes ahead on a separate thread", "size" },
         { "find_stream_info", OPT_BOOL | OPT_INPUT | OPT_EXPERT | OPT_OFFSET, { .off = OFFSET(find_stream_info) },
             "read and decode the streams to fill missing information with heuristics" },
         { "bits_per_raw_sample", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_SPEC | OPT_OUTPUT,
@@ -4837,9 +4996,9 @@ int ffmpeg_execute(int argc, char **argv)
         if ((decode_error_stat[0] + decode_error_stat[1]) * max_error_rate < decode_error_stat[1])
             exit_program(69);
 
-        exit_program((received_nb_signals || session->cancel_requested)? 255 : main_ffmpeg_return_code);
+        exit_program((received_nb_signals || fftools_cancel_requested())? 255 : main_ffmpeg_return_code);
     } else {
-        main_ffmpeg_return_code = (received_nb_signals || session->cancel_requested) ? 255 : longjmp_value;
+        main_ffmpeg_return_code = (received_nb_signals || fftools_cancel_requested()) ? 255 : longjmp_value;
     }
     return main_ffmpeg_return_code;
 }
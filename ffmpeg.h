@@ -124,6 +124,8 @@ typedef struct OptionsContext {
     float readrate;
     int accurate_seek;
     int thread_queue_size;
+    const char *read_wait;
+    int64_t readahead;
     int input_sync_ref;
     int find_stream_info;
 
@@ -654,7 +656,7 @@ typedef struct OutputStream {
 
     /* stats */
     // combined size of all the packets sent to the muxer
-    uint64_t data_size_mux;
+    atomic_uint_least64_t data_size_mux;
     // combined size of all the packets received from the encoder
     uint64_t data_size_enc;
     // number of packets send to the muxer
@@ -664,6 +666,9 @@ typedef struct OutputStream {
     uint64_t samples_encoded;
     // number of packets received from the encoder
     uint64_t packets_encoded;
+    // number of frames duplicated/dropped by the video sync code
+    int64_t nb_frames_dup;
+    int64_t nb_frames_drop;
 
     /* packet quality factor */
     int quality;
@@ -747,7 +752,7 @@ extern __thread int filter_complex_nbthreads;
 extern __thread int vstats_version;
 extern __thread int auto_conversion_filters;
 
-extern __thread const AVIOInterruptCB int_cb;
+extern __thread AVIOInterruptCB int_cb;
 
 extern __thread HWDevice *filter_hw_device;
 
@@ -789,6 +794,11 @@ void sub2video_update(InputStream *ist, int64_t heartbeat_pts, AVSubtitle *sub);
 int ifilter_parameters_from_frame(InputFilter *ifilter, const AVFrame *frame);
 
 int ffmpeg_parse_options(int argc, char **argv);
+/**
+ * Reset the option globals to their defaults, so a pooled worker thread
+ * starts each job in the same state as a freshly created one.
+ */
+void ffmpeg_opt_var_cleanup(void);
 
 void enc_stats_write(OutputStream *ost, EncStats *es,
                      const AVFrame *frame, const AVPacket *pkt,
@@ -805,6 +815,12 @@ int hw_device_setup_for_filter(FilterGraph *fg);
 int hwaccel_decode_init(AVCodecContext *avctx);
 
 void set_report_callback(void (*callback)(int, float, float, int64_t, int, double, double));
+struct FFToolsOutputStatistics;
+struct FFToolsInputStatistics;
+/* the callback takes ownership of the records, which are freed with av_free(outputs) */
+void set_output_report_callback(void (*callback)(struct FFToolsOutputStatistics *outputs, int nb_outputs,
+                                                 struct FFToolsInputStatistics *inputs, int nb_inputs,
+                                                 int is_last));
 
 void cancel_operation(long id);
 
@@ -882,11 +898,17 @@ int64_t of_filesize(OutputFile *of);
 
 int ifile_open(const OptionsContext *o, const char *filename);
 void ifile_close(InputFile **f);
+/**
+ * Fill st with the current statistics of f, may be called while the demuxer
+ * thread runs.
+ */
+void ifile_statistics(InputFile *f, struct FFToolsInputStatistics *st);
 
 /**
  * Get next input packet from the demuxer.
  *
- * @param pkt the packet is written here when this function returns 0
+ * @param pkt the packet is written here when this function returns 0; hand it
+ *            back with ifile_release_packet()
  * @return
  * - 0 when a packet has been read successfully
  * - 1 when stream end was reached, but the stream is looped;
@@ -894,6 +916,11 @@ void ifile_close(InputFile **f);
  * - a negative error code on failure
  */
 int ifile_get_packet(InputFile *f, AVPacket **pkt);
+/**
+ * Unreference a packet returned by ifile_get_packet() and keep it for reuse by
+ * the demuxer thread. Sets *pkt to NULL.
+ */
+void ifile_release_packet(InputFile *f, AVPacket **pkt);
 
 /* iterate over all input streams in all input files;
  * pass NULL to start iteration */
@@ -18,6 +18,7 @@
 
 #include <float.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 #include "ffmpeg.h"
 
@@ -39,6 +40,12 @@
 #include "libavformat/avformat.h"
 
 #include "fftools.h"
+#include "read_ahead.h"
+#include "ring_queue.h"
+
+#if HAVE_POLL_H
+#include <poll.h>
+#endif
 
 static const char *const opt_name_discard[]                   = {"discard", NULL};
 static const char *const opt_name_reinit_filters[]            = {"reinit_filter", NULL};
@@ -54,6 +61,30 @@ static const char *const opt_name_display_rotations[]         = {"display_rotati
 static const char *const opt_name_display_hflips[]            = {"display_hflip", NULL};
 static const char *const opt_name_display_vflips[]            = {"display_vflip", NULL};
 
+/* how input_thread() waits when the demuxer returns EAGAIN, see -read_wait */
+enum ReadWait {
+    /* like READ_WAIT_BACKOFF, but blocking in poll() on pipe inputs */
+    READ_WAIT_ADAPTIVE,
+    /* retry right away a few times, then sleep for exponentially longer */
+    READ_WAIT_BACKOFF,
+    /* sleep READ_WAIT_MAX_DELAY every time */
+    READ_WAIT_SLEEP,
+};
+
+/* packets the demuxer thread queue may grow to when its size is tuned */
+#define DEMUX_QUEUE_MAX_PACKETS  1024
+/* the queue only grows while the packets in it take less than this */
+#define DEMUX_QUEUE_MAX_BYTES    (8 << 20)
+/* packets sent between checks whether the queue can shrink */
+#define DEMUX_QUEUE_SHRINK_PERIOD 256
+
+/* immediate retries before waiting, unless sleeping with READ_WAIT_SLEEP */
+#define READ_WAIT_SPINS      16
+/* bounds of the backoff delay in microseconds; waits never exceed the
+ * maximum so that cancellation is noticed */
+#define READ_WAIT_MIN_DELAY  50
+#define READ_WAIT_MAX_DELAY  10000
+
 typedef struct Demuxer {
     InputFile f;
 
@@ -70,10 +101,57 @@ typedef struct Demuxer {
 
     AVThreadMessageQueue *in_thread_queue;
     int                   thread_queue_size;
+    /* Unless -thread_queue_size is given, in_thread_queue is allocated for
+     * DEMUX_QUEUE_MAX_PACKETS and the demuxer thread keeps it below
+     * queue_limit, which it tunes between queue_min and that.
+     * The queue grows when it fills up after the main thread found it empty,
+     * as a larger queue would have absorbed the burst, and shrinks when it
+     * stays mostly empty. */
+    int                   queue_tuned;
+    /* also read by the main thread for statistics, as are the depth and
+     * resize counters below */
+    atomic_int            queue_limit;
+    int                   queue_min;
+    /* payload bytes in the queue */
+    atomic_int_least64_t  queued_bytes;
+    /* set by the main thread when it finds the queue empty */
+    atomic_int            queue_starved;
+    /* the demuxer thread waits here for the queue to go below queue_limit */
+    pthread_mutex_t       room_lock;
+    pthread_cond_t        room_cond;
+    atomic_int            room_waiting;
+    atomic_int            stopping;
+    int                   nb_sent_period;
+    int                   max_depth_period;
+    atomic_int            max_queue_depth;
+    atomic_int            nb_queue_resizes;
+    /* blank packets handed back by the main thread for the demuxer thread
+     * to fill, so that a steady stream of packets allocates nothing */
+    RingQueue            *pkt_pool;
+    /* packets allocated because the pool was empty */
+    uint64_t              nb_pkt_allocs;
     pthread_t             thread;
     int                   non_blocking;
+
+    enum ReadWait         read_wait;
+    /* descriptor of a pipe input for READ_WAIT_ADAPTIVE, -1 for others */
+    int                   read_fd;
+    /* consecutive polls that reported input right away, yet yielded no packet */
+    int                   nb_idle_polls;
+    /* time input_thread() spent waiting for input */
+    int64_t               read_wait_time;
+
+    /* reads the input ahead on a thread of its own, see -readahead */
+    ReadAhead            *readahead;
+
     /* To fix log callbacks in demuxer thread */
     FFToolsSession       *session;
+
+    /* accounting for FFToolsSessionSummary, only kept if it was requested */
+    int     accounting;
+    int64_t cpu_time;
+    int64_t queue_full_time;
+    int64_t queue_empty_time;
 } Demuxer;
 
 typedef struct DemuxMsg {
@@ -238,12 +316,158 @@ static void thread_set_name(InputFile *f)
     ff_thread_setname(name);
 }
 
+static int send_blocking(Demuxer *d, DemuxMsg *msg)
+{
+    int64_t start = d->accounting ? av_gettime_relative() : 0;
+    int ret = av_thread_message_queue_send(d->in_thread_queue, msg, 0);
+
+    if (d->accounting)
+        d->queue_full_time += av_gettime_relative() - start;
+    return ret;
+}
+
+/* wait before reading again after the nb_tries-th EAGAIN in a row */
+static void wait_to_read(Demuxer *d, int nb_tries)
+{
+    int64_t start, delay;
+
+    if (d->read_wait == READ_WAIT_SLEEP)
+        delay = READ_WAIT_MAX_DELAY;
+    else if (nb_tries <= READ_WAIT_SPINS)
+        return;
+    else
+        delay = FFMIN((int64_t)READ_WAIT_MIN_DELAY << FFMIN(nb_tries - READ_WAIT_SPINS - 1, 16),
+                      READ_WAIT_MAX_DELAY);
+
+    start = av_gettime_relative();
+
+#if HAVE_POLL_H
+    /* a descriptor that stays readable while the demuxer makes no progress
+     * would make this spin, so fall back to sleeping then */
+    if (d->read_fd >= 0 && d->nb_idle_polls < 2) {
+        struct pollfd pfd = { .fd = d->read_fd, .events = POLLIN };
+        int ret = poll(&pfd, 1, READ_WAIT_MAX_DELAY / 1000);
+
+        if (ret >= 0) {
+            if (ret > 0 && av_gettime_relative() - start < READ_WAIT_MIN_DELAY)
+                d->nb_idle_polls++;
+            d->read_wait_time += av_gettime_relative() - start;
+            return;
+        }
+    }
+#endif
+
+    av_usleep(delay);
+    d->read_wait_time += av_gettime_relative() - start;
+}
+
+static void queue_resize(Demuxer *d, int limit)
+{
+    av_log(d->f.ctx, AV_LOG_VERBOSE, "Thread message queue %s to %d packets\n",
+           limit > d->queue_limit ? "grown" : "shrunk", limit);
+    d->queue_limit = limit;
+    d->nb_queue_resizes++;
+}
+
+static void wait_for_room(Demuxer *d)
+{
+    int64_t start = d->accounting ? av_gettime_relative() : 0;
+
+    pthread_mutex_lock(&d->room_lock);
+    atomic_store(&d->room_waiting, 1);
+    while (av_thread_message_queue_nb_elems(d->in_thread_queue) >= d->queue_limit &&
+           !atomic_load(&d->stopping))
+        pthread_cond_wait(&d->room_cond, &d->room_lock);
+    atomic_store(&d->room_waiting, 0);
+    pthread_mutex_unlock(&d->room_lock);
+
+    if (d->accounting)
+        d->queue_full_time += av_gettime_relative() - start;
+}
+
+/* called after taking a message from the queue or stopping the thread */
+static void signal_room(Demuxer *d)
+{
+    /* pairs with the store in wait_for_room(): either the demuxer thread sees
+     * the room, or it is waiting and gets woken up */
+    if (atomic_load(&d->room_waiting)) {
+        pthread_mutex_lock(&d->room_lock);
+        pthread_cond_broadcast(&d->room_cond);
+        pthread_mutex_unlock(&d->room_lock);
+    }
+}
+
+/* send a packet, keeping the queue below queue_limit and tuning that */
+static int send_tuned(Demuxer *d, DemuxMsg *msg)
+{
+    int depth = av_thread_message_queue_nb_elems(d->in_thread_queue);
+    int size  = msg->pkt->size;
+    int ret;
+
+    if (depth >= d->queue_limit) {
+        if (atomic_exchange(&d->queue_starved, 0) &&
+            d->queue_limit < d->thread_queue_size &&
+            atomic_load(&d->queued_bytes) + size <= DEMUX_QUEUE_MAX_BYTES)
+            queue_resize(d, FFMIN(d->queue_limit * 2, d->thread_queue_size));
+        else
+            wait_for_room(d);
+        depth = av_thread_message_queue_nb_elems(d->in_thread_queue);
+    }
+
+    d->max_depth_period = FFMAX(d->max_depth_period, depth + 1);
+    d->max_queue_depth  = FFMAX(d->max_queue_depth,  depth + 1);
+    if (++d->nb_sent_period == DEMUX_QUEUE_SHRINK_PERIOD) {
+        if (d->queue_limit > d->queue_min && d->max_depth_period <= d->queue_limit / 4)
+            queue_resize(d, FFMAX(d->queue_limit / 2, d->queue_min));
+        d->nb_sent_period   = 0;
+        d->max_depth_period = 0;
+    }
+
+    /* below the allocated size, so this does not block */
+    atomic_fetch_add(&d->queued_bytes, size);
+    ret = av_thread_message_queue_send(d->in_thread_queue, msg, 0);
+    if (ret < 0)
+        atomic_fetch_sub(&d->queued_bytes, size);
+    return ret;
+}
+
+static AVPacket *packet_get(Demuxer *d)
+{
+    AVPacket *pkt;
+
+    if (rq_try_receive(d->pkt_pool, &pkt) >= 0)
+        return pkt;
+
+    d->nb_pkt_allocs++;
+    return av_packet_alloc();
+}
+
+void ifile_release_packet(InputFile *f, AVPacket **ppkt)
+{
+    Demuxer  *d   = demuxer_from_ifile(f);
+    AVPacket *pkt = *ppkt;
+
+    if (!pkt)
+        return;
+
+    av_packet_unref(pkt);
+    if (!d->pkt_pool || rq_try_send(d->pkt_pool, &pkt) < 0)
+        av_packet_free(&pkt);
+    *ppkt = NULL;
+}
+
+static void pool_packet_free(void *elem)
+{
+    av_packet_free(elem);
+}
+
 static void *input_thread(void *arg)
 {
     Demuxer   *d = arg;
     InputFile *f = &d->f;
     AVPacket *pkt;
     unsigned flags = d->non_blocking ? AV_THREAD_MESSAGE_NONBLOCK : 0;
+    int nb_tries = 0;
     int ret = 0;
 
     session = d->session;
@@ -262,16 +486,24 @@ static void *input_thread(void *arg)
         ret = av_read_frame(f->ctx, pkt);
 
         if (ret == AVERROR(EAGAIN)) {
-            av_usleep(10000);
+            if (fftools_cancel_requested()) {
+                ret = AVERROR_EXIT;
+                break;
+            }
+            wait_to_read(d, ++nb_tries);
             continue;
         }
+        nb_tries = 0;
+        d->nb_idle_polls = 0;
         if (ret < 0) {
             if (d->loop) {
                 /* signal looping to the consumer thread */
                 msg.looping = 1;
-                ret = av_thread_message_queue_send(d->in_thread_queue, &msg, 0);
-                if (ret >= 0)
+                ret = send_blocking(d, &msg);
+                if (ret >= 0) {
+                    fftools_input_signal(d->session);
                     ret = seek_to_start(d);
+                }
                 if (ret >= 0)
                     continue;
 
@@ -313,22 +545,31 @@ static void *input_thread(void *arg)
 
         ts_fixup(d, pkt, &msg.repeat_pict);
 
-        msg.pkt = av_packet_alloc();
+        msg.pkt = packet_get(d);
         if (!msg.pkt) {
             av_packet_unref(pkt);
             ret = AVERROR(ENOMEM);
             break;
         }
         av_packet_move_ref(msg.pkt, pkt);
-        ret = av_thread_message_queue_send(d->in_thread_queue, &msg, flags);
+        if (d->queue_tuned)
+            ret = send_tuned(d, &msg);
+        else
+            ret = flags ? av_thread_message_queue_send(d->in_thread_queue, &msg, flags) :
+                          send_blocking(d, &msg);
         if (flags && ret == AVERROR(EAGAIN)) {
             flags = 0;
-            ret = av_thread_message_queue_send(d->in_thread_queue, &msg, flags);
+            ret = send_blocking(d, &msg);
             av_log(f->ctx, AV_LOG_WARNING,
                    "Thread message queue blocking; consider raising the "
                    "thread_queue_size option (current value: %d)\n",
                    d->thread_queue_size);
         }
+        if (ret >= 0 && !d->queue_tuned) {
+            /* send_tuned() tracks it when tuning */
+            int depth = av_thread_message_queue_nb_elems(d->in_thread_queue);
+            d->max_queue_depth = FFMAX(d->max_queue_depth, depth);
+        }
         if (ret < 0) {
             if (ret != AVERROR_EOF)
                 av_log(f->ctx, AV_LOG_ERROR,
@@ -337,15 +578,21 @@ static void *input_thread(void *arg)
             av_packet_free(&msg.pkt);
             break;
         }
+        /* wake up the main thread if it waits for any input */
+        fftools_input_signal(d->session);
     }
 
 finish:
     av_assert0(ret < 0);
+    if (d->accounting)
+        d->cpu_time = fftools_thread_cpu_time();
     av_thread_message_queue_set_err_recv(d->in_thread_queue, ret);
+    fftools_input_signal(d->session);
 
     av_packet_free(&pkt);
 
-    av_log(NULL, AV_LOG_VERBOSE, "Terminating demuxer thread %d\n", f->index);
+    av_log(NULL, AV_LOG_VERBOSE, "Terminating demuxer thread %d, waited %.3fs for input\n",
+           f->index, d->read_wait_time / 1e6);
 
     return NULL;
 }
@@ -358,11 +605,16 @@ static void thread_stop(Demuxer *d)
     if (!d->in_thread_queue)
         return;
     av_thread_message_queue_set_err_send(d->in_thread_queue, AVERROR_EOF);
+    atomic_store(&d->stopping, 1);
+    signal_room(d);
     while (av_thread_message_queue_recv(d->in_thread_queue, &msg, 0) >= 0)
         av_packet_free(&msg.pkt);
 
     pthread_join(d->thread, NULL);
     av_thread_message_queue_free(&d->in_thread_queue);
+    rq_free(&d->pkt_pool);
+    pthread_mutex_destroy(&d->room_lock);
+    pthread_cond_destroy(&d->room_cond);
     av_thread_message_queue_free(&f->audio_duration_queue);
 }
 
@@ -371,8 +623,12 @@ static int thread_start(Demuxer *d)
     int ret;
     InputFile *f = &d->f;
 
-    if (d->thread_queue_size <= 0)
-        d->thread_queue_size = (nb_input_files > 1 ? 8 : 1);
+    if (d->thread_queue_size <= 0) {
+        d->queue_tuned       = 1;
+        d->queue_min         = (nb_input_files > 1 ? 8 : 1);
+        d->queue_limit       = d->queue_min;
+        d->thread_queue_size = DEMUX_QUEUE_MAX_PACKETS;
+    }
 
     if (nb_input_files > 1 &&
         (f->ctx->pb ? !f->ctx->pb->seekable :
@@ -383,6 +639,20 @@ static int thread_start(Demuxer *d)
     if (ret < 0)
         return ret;
 
+    pthread_mutex_init(&d->room_lock, NULL);
+    pthread_cond_init(&d->room_cond, NULL);
+    atomic_init(&d->queued_bytes, 0);
+    atomic_init(&d->queue_starved, 0);
+    atomic_init(&d->room_waiting, 0);
+    atomic_init(&d->stopping, 0);
+
+    /* room for the packets of a full queue plus those being demuxed and processed */
+    d->pkt_pool = rq_alloc(d->thread_queue_size + 2, sizeof(AVPacket*), pool_packet_free);
+    if (!d->pkt_pool) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
     if (d->loop) {
         int nb_audio_dec = 0;
 
@@ -403,6 +673,7 @@ static int thread_start(Demuxer *d)
 
     // Propagate session to child thread
     d->session = session;
+    d->accounting = !!session->summary;
 
     if ((ret = pthread_create(&d->thread, NULL, input_thread, d))) {
         av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
@@ -413,6 +684,9 @@ static int thread_start(Demuxer *d)
     return 0;
 fail:
     av_thread_message_queue_free(&d->in_thread_queue);
+    rq_free(&d->pkt_pool);
+    pthread_mutex_destroy(&d->room_lock);
+    pthread_cond_destroy(&d->room_cond);
     return ret;
 }
 
@@ -448,11 +722,24 @@ int ifile_get_packet(InputFile *f, AVPacket **pkt)
         }
     }
 
-    ret = av_thread_message_queue_recv(d->in_thread_queue, &msg,
-                                       d->non_blocking ?
-                                       AV_THREAD_MESSAGE_NONBLOCK : 0);
+    if (d->queue_tuned && !av_thread_message_queue_nb_elems(d->in_thread_queue))
+        atomic_store(&d->queue_starved, 1);
+
+    if (d->accounting && !d->non_blocking) {
+        int64_t start = av_gettime_relative();
+        ret = av_thread_message_queue_recv(d->in_thread_queue, &msg, 0);
+        d->queue_empty_time += av_gettime_relative() - start;
+    } else
+        ret = av_thread_message_queue_recv(d->in_thread_queue, &msg,
+                                           d->non_blocking ?
+                                           AV_THREAD_MESSAGE_NONBLOCK : 0);
     if (ret < 0)
         return ret;
+    if (d->queue_tuned) {
+        if (msg.pkt)
+            atomic_fetch_sub(&d->queued_bytes, msg.pkt->size);
+        signal_room(d);
+    }
     if (msg.looping)
         return 1;
 
@@ -479,12 +766,29 @@ static void ist_free(InputStream **pist)
     av_freep(&ist->hwaccel_device);
     av_freep(&ist->dts_buffer);
 
+    fftools_unregister_log_context(ist->dec_ctx);
+    fftools_unregister_log_context(ist);
     avcodec_free_context(&ist->dec_ctx);
     avcodec_parameters_free(&ist->par);
 
     av_freep(pist);
 }
 
+void ifile_statistics(InputFile *f, FFToolsInputStatistics *st)
+{
+    Demuxer *d = demuxer_from_ifile(f);
+
+    st->file_index      = f->index;
+    st->packets         = 0;
+    for (int i = 0; i < f->nb_streams; i++)
+        st->packets += f->streams[i]->nb_packets;
+    st->queue_depth     = d->in_thread_queue ?
+                          av_thread_message_queue_nb_elems(d->in_thread_queue) : 0;
+    st->queue_size      = d->queue_tuned ? d->queue_limit : d->thread_queue_size;
+    st->max_queue_depth = d->max_queue_depth;
+    st->queue_resizes   = d->nb_queue_resizes;
+}
+
 void ifile_close(InputFile **pf)
 {
     InputFile *f = *pf;
@@ -495,11 +799,32 @@ void ifile_close(InputFile **pf)
 
     thread_stop(d);
 
+    av_log(NULL, AV_LOG_VERBOSE, "Input file #%d: allocated %"PRIu64" packets\n",
+           f->index, d->nb_pkt_allocs);
+
+    if (d->accounting) {
+        FFToolsInputSummary *acc = fftools_summary_input(f->index);
+        if (acc) {
+            acc->bytes_read       = f->ctx && f->ctx->pb ? f->ctx->pb->bytes_read : -1;
+            acc->cpu_time         = d->cpu_time;
+            acc->queue_full_time  = d->queue_full_time;
+            acc->queue_empty_time = d->queue_empty_time;
+            acc->read_wait_time   = d->read_wait_time;
+            acc->packet_allocs    = d->nb_pkt_allocs;
+            acc->queue_size       = d->queue_tuned ? d->queue_limit : d->thread_queue_size;
+            acc->max_queue_depth  = d->max_queue_depth;
+            acc->queue_resizes    = d->nb_queue_resizes;
+            for (int i = 0; i < f->nb_streams; i++)
+                acc->packets += f->streams[i]->nb_packets;
+        }
+    }
+
     for (int i = 0; i < f->nb_streams; i++)
         ist_free(&f->streams[i]);
     av_freep(&f->streams);
 
     avformat_close_input(&f->ctx);
+    ra_close(&d->readahead);
 
     av_freep(pf);
 }
@@ -848,6 +1173,36 @@ static void dump_attachment(AVStream *st, const char *filename)
     avio_close(out);
 }
 
+/* only local inputs are worth reading ahead; network protocols buffer
+ * on their own */
+static int read_ahead_supported(const char *url)
+{
+    const char *proto = avio_find_protocol_name(url);
+
+    return HAVE_POLL_H && proto &&
+           (!strcmp(proto, "file") || !strcmp(proto, "pipe") ||
+            !strcmp(proto, "fd"));
+}
+
+/* descriptor a pipe input is read from, -1 for other inputs */
+static int pipe_fd(const char *url, const AVDictionary *format_opts)
+{
+    const AVDictionaryEntry *e = av_dict_get(format_opts, "fd", NULL, 0);
+    const char *p;
+    char *end;
+    long fd;
+
+    if (!strcmp(url, "fd:") || !strcmp(url, "pipe:"))
+        return e ? atoi(e->value) : 0;
+    if (!strcmp(url, "/dev/stdin"))
+        return 0;
+    if (!av_strstart(url, "pipe:", &p))
+        return -1;
+
+    fd = strtol(p, &end, 10);
+    return end != p && !*end && fd >= 0 && fd <= INT_MAX ? fd : 0;
+}
+
 int ifile_open(const OptionsContext *o, const char *filename)
 {
     Demuxer   *d;
@@ -863,6 +1218,7 @@ int ifile_open(const OptionsContext *o, const char *filename)
     char *subtitle_codec_name = NULL;
     char *    data_codec_name = NULL;
     int scan_all_pmts_set = 0;
+    int read_fd;
 
     int64_t start_time     = o->start_time;
     int64_t start_time_eof = o->start_time_eof;
@@ -968,9 +1324,29 @@ int ifile_open(const OptionsContext *o, const char *filename)
         av_dict_set(&o->g->format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
         scan_all_pmts_set = 1;
     }
+    /* allocated before opening, so that the I/O thread reading ahead is
+     * stopped by ifile_close() on any of the failures below */
+    d = allocate_array_elem(&input_files, sizeof(*d), &nb_input_files);
+    f = &d->f;
+    f->index = nb_input_files - 1;
+
+    /* opening consumes the protocol options, among them -fd */
+    read_fd = pipe_fd(filename, o->g->format_opts);
+
+    if (o->readahead > 0 && read_ahead_supported(filename)) {
+        err = ra_open(&d->readahead, &ic->pb, filename, read_fd, o->readahead,
+                      &ic->interrupt_callback, &o->g->format_opts);
+        if (err < 0) {
+            print_error(filename, err);
+            exit_program(1);
+        }
+        ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
     /* open the input file with generic avformat function */
     err = avformat_open_input(&ic, filename, file_iformat, &o->g->format_opts);
     if (err < 0) {
+        ra_close(&d->readahead);
         print_error(filename, err);
         if (err == AVERROR_PROTOCOL_NOT_FOUND)
             av_log(NULL, AV_LOG_ERROR, "Did you mean file:%s?\n", filename);
@@ -1054,11 +1430,7 @@ int ifile_open(const OptionsContext *o, const char *filename)
         }
     }
 
-    d = allocate_array_elem(&input_files, sizeof(*d), &nb_input_files);
-    f = &d->f;
-
     f->ctx        = ic;
-    f->index      = nb_input_files - 1;
     f->start_time = start_time;
     f->recording_time = recording_time;
     f->input_sync_ref = o->input_sync_ref;
@@ -1082,6 +1454,22 @@ int ifile_open(const OptionsContext *o, const char *filename)
 
     d->thread_queue_size = o->thread_queue_size;
 
+    d->read_wait = READ_WAIT_ADAPTIVE;
+    if (o->read_wait) {
+        if (!strcmp(o->read_wait, "backoff"))
+            d->read_wait = READ_WAIT_BACKOFF;
+        else if (!strcmp(o->read_wait, "sleep"))
+            d->read_wait = READ_WAIT_SLEEP;
+        else if (strcmp(o->read_wait, "adaptive")) {
+            av_log(NULL, AV_LOG_FATAL, "Invalid -read_wait mode '%s' for Input #%d; "
+                   "use adaptive, backoff or sleep.\n", o->read_wait, f->index);
+            exit_program(1);
+        }
+    }
+    /* with -readahead the descriptor is drained by the I/O thread, whose
+     * buffer is what the demuxer actually waits on */
+    d->read_fd = d->read_wait == READ_WAIT_ADAPTIVE && !d->readahead ? read_fd : -1;
+
     /* update the current parameters so that they match the one of the input stream */
     add_input_streams(o, d);
 
@@ -21,6 +21,7 @@
 #include <stdint.h>
 
 #include "ffmpeg.h"
+#include "fftools.h"
 
 #include "libavfilter/avfilter.h"
 #include "libavfilter/buffersink.h"
@@ -1082,6 +1083,7 @@ static void cleanup_filtergraph(FilterGraph *fg)
         fg->outputs[i]->filter = (AVFilterContext *)NULL;
     for (i = 0; i < fg->nb_inputs; i++)
         fg->inputs[i]->filter = (AVFilterContext *)NULL;
+    fftools_unregister_log_context(fg->graph);
     avfilter_graph_free(&fg->graph);
 }
 
@@ -1119,6 +1121,7 @@ int configure_filtergraph(FilterGraph *fg)
     cleanup_filtergraph(fg);
     if (!(fg->graph = avfilter_graph_alloc()))
         return AVERROR(ENOMEM);
+    fftools_register_log_context(fg->graph);
 
     if (simple) {
         OutputStream *ost = fg->outputs[0]->ost;
@@ -1132,6 +1135,8 @@ int configure_filtergraph(FilterGraph *fg)
             e = av_dict_get(ost->encoder_opts, "threads", NULL, 0);
             if (e)
                 av_opt_set(fg->graph, "threads", e->value, 0);
+            else
+                fg->graph->nb_threads = fftools_thread_budget();
         }
 
         if (av_dict_count(ost->sws_dict)) {
@@ -1151,7 +1156,8 @@ int configure_filtergraph(FilterGraph *fg)
             av_free(args);
         }
     } else {
-        fg->graph->nb_threads = filter_complex_nbthreads;
+        fg->graph->nb_threads = filter_complex_nbthreads ? filter_complex_nbthreads
+                                                         : fftools_thread_budget();
     }
 
     if ((ret = graph_parse(fg->graph, graph_desc, &inputs, &outputs)) < 0)
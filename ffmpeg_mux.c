@@ -22,6 +22,7 @@
 
 #include "ffmpeg.h"
 #include "ffmpeg_mux.h"
+#include "fftools.h"
 #include "objpool.h"
 #include "sync_queue.h"
 #include "thread_queue.h"
@@ -30,6 +31,7 @@
 #include "libavutil/intreadwrite.h"
 #include "libavutil/log.h"
 #include "libavutil/mem.h"
+#include "libavutil/time.h"
 #include "libavutil/timestamp.h"
 #include "libavutil/thread.h"
 
@@ -128,7 +130,7 @@ static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
     }
     ms->last_mux_dts = pkt->dts;
 
-    ost->data_size_mux += pkt->size;
+    atomic_fetch_add(&ost->data_size_mux, pkt->size);
     frame_num = atomic_fetch_add(&ost->packets_written, 1);
 
     pkt->stream_index = ost->index;
@@ -216,7 +218,12 @@ static void *muxer_thread(void *arg)
         OutputStream *ost;
         int stream_idx, stream_eof = 0;
 
-        ret = tq_receive(mux->tq, &stream_idx, pkt);
+        if (mux->accounting) {
+            int64_t start = av_gettime_relative();
+            ret = tq_receive(mux->tq, &stream_idx, pkt);
+            mux->queue_empty_time += av_gettime_relative() - start;
+        } else
+            ret = tq_receive(mux->tq, &stream_idx, pkt);
         if (stream_idx < 0) {
             av_log(mux, AV_LOG_VERBOSE, "All streams finished\n");
             ret = 0;
@@ -237,6 +244,9 @@ static void *muxer_thread(void *arg)
 finish:
     av_packet_free(&pkt);
 
+    if (mux->accounting)
+        mux->cpu_time = fftools_thread_cpu_time();
+
     for (unsigned int i = 0; i < mux->fc->nb_streams; i++)
         tq_receive_finish(mux->tq, i);
 
@@ -252,7 +262,12 @@ static int thread_submit_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
     if (!pkt || ost->finished & MUXER_FINISHED)
         goto finish;
 
-    ret = tq_send(mux->tq, ost->index, pkt);
+    if (mux->accounting) {
+        int64_t start = av_gettime_relative();
+        ret = tq_send(mux->tq, ost->index, pkt);
+        mux->queue_full_time += av_gettime_relative() - start;
+    } else
+        ret = tq_send(mux->tq, ost->index, pkt);
     if (ret < 0)
         goto finish;
 
@@ -420,6 +435,7 @@ static int thread_start(Muxer *mux)
     }
 
     mux->session = session;
+    mux->accounting = !!session->summary;
 
     ret = pthread_create(&mux->thread, NULL, muxer_thread, (void*)mux);
     if (ret) {
@@ -690,6 +706,8 @@ static void ost_free(OutputStream **post)
 
     if (ost->enc_ctx)
         av_freep(&ost->enc_ctx->stats_in);
+    fftools_unregister_log_context(ost->enc_ctx);
+    fftools_unregister_log_context(ost);
     avcodec_free_context(&ost->enc_ctx);
 
     for (int i = 0; i < ost->enc_stats_pre.nb_components; i++)
@@ -732,6 +750,21 @@ void of_close(OutputFile **pof)
 
     thread_stop(mux);
 
+    if (mux->accounting) {
+        FFToolsOutputSummary *acc = fftools_summary_output(of->index);
+        if (acc) {
+            acc->bytes_written    = mux->fc && mux->fc->pb ? filesize(mux->fc->pb) :
+                                                             atomic_load(&mux->last_filesize);
+            acc->cpu_time         = mux->cpu_time;
+            acc->queue_full_time  = mux->queue_full_time;
+            acc->queue_empty_time = mux->queue_empty_time;
+            for (int i = 0; i < of->nb_streams; i++) {
+                acc->packets        += atomic_load(&of->streams[i]->packets_written);
+                acc->frames_encoded += of->streams[i]->frames_encoded;
+            }
+        }
+    }
+
     sq_free(&of->sq_encode);
     sq_free(&mux->sq_mux);
 
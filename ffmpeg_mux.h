@@ -91,6 +91,12 @@ typedef struct Muxer {
     AVPacket *sq_pkt;
     /* To fix log callbacks in demuxer thread */
     FFToolsSession *session;
+
+    /* accounting for FFToolsSessionSummary, only kept if it was requested */
+    int     accounting;
+    int64_t cpu_time;
+    int64_t queue_full_time;
+    int64_t queue_empty_time;
 } Muxer;
 
 /* whether we want to print an SDP, set in of_open() */
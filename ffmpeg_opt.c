@@ -100,6 +100,49 @@ __thread int ignore_unknown_streams = 0;
 __thread int copy_unknown_streams = 0;
 __thread int recast_media = 0;
 
+void ffmpeg_opt_var_cleanup(void)
+{
+    filter_hw_device = NULL;
+
+    vstats_filename = NULL;
+    sdp_filename    = NULL;
+
+    audio_drift_threshold = 0.1;
+    dts_delta_threshold   = 10;
+    dts_error_threshold   = 3600*30;
+
+    video_sync_method = VSYNC_AUTO;
+    frame_drop_threshold = 0;
+    do_benchmark      = 0;
+    do_benchmark_all  = 0;
+    do_hex_dump       = 0;
+    do_pkt_dump       = 0;
+    copy_ts           = 0;
+    start_at_zero     = 0;
+    copy_tb           = -1;
+    debug_ts          = 0;
+    exit_on_error     = 0;
+    abort_on_flags    = 0;
+    print_stats       = -1;
+    qp_hist           = 0;
+    stdin_interaction = 0;
+    max_error_rate    = 2.0/3;
+    filter_nbthreads  = NULL;
+    filter_complex_nbthreads = 0;
+    vstats_version = 2;
+    auto_conversion_filters = 1;
+    stats_period = 500000;
+
+    file_overwrite     = 0;
+    no_file_overwrite  = 0;
+#if FFMPEG_OPT_PSNR
+    do_psnr            = 0;
+#endif
+    ignore_unknown_streams = 0;
+    copy_unknown_streams = 0;
+    recast_media = 0;
+}
+
 static void uninit_options(OptionsContext *o)
 {
     const OptionDef *po = session->options;
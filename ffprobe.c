@@ -481,6 +481,7 @@ struct WriterContext {
     const AVClass *class;           ///< class of the writer
     const Writer *writer;           ///< the Writer of which this is an instance
     AVIOContext *avio;              ///< the I/O context used to write
+    AVBPrint *bprint;               ///< the buffer written to instead of printing, if set
 
     void (* writer_w8)(WriterContext *wctx, int b);
     void (* writer_put_str)(WriterContext *wctx, const char *str);
@@ -618,6 +619,25 @@ static inline void writer_printf_printf(WriterContext *wctx, const char *fmt, ..
     va_end(ap);
 }
 
+static inline void writer_w8_bprint(WriterContext *wctx, int b)
+{
+    av_bprint_chars(wctx->bprint, b, 1);
+}
+
+static inline void writer_put_str_bprint(WriterContext *wctx, const char *str)
+{
+    av_bprint_append_data(wctx->bprint, str, strlen(str));
+}
+
+static inline void writer_printf_bprint(WriterContext *wctx, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    av_vbprintf(wctx->bprint, fmt, ap);
+    va_end(ap);
+}
+
 static int writer_open(WriterContext **wctx, const Writer *writer, const char *args,
                        const struct section *sections, int nb_sections, const char *output)
 {
@@ -690,7 +710,11 @@ static int writer_open(WriterContext **wctx, const Writer *writer, const char *a
         }
     }
 
-    if (!output_filename) {
+    if (!output_filename && ((*wctx)->bprint = fftools_output_buffer())) {
+        (*wctx)->writer_w8 = writer_w8_bprint;
+        (*wctx)->writer_put_str = writer_put_str_bprint;
+        (*wctx)->writer_printf = writer_printf_bprint;
+    } else if (!output_filename) {
         (*wctx)->writer_w8 = writer_w8_printf;
         (*wctx)->writer_put_str = writer_put_str_printf;
         (*wctx)->writer_printf = writer_printf_printf;
@@ -2870,6 +2894,10 @@ static int read_interval_packets(WriterContext *w, InputFile *ifile,
         goto end;
     }
     while (!av_read_frame(fmt_ctx, pkt)) {
+        if (fftools_cancel_requested()) {
+            ret = AVERROR_EXIT;
+            goto end;
+        }
         if (fmt_ctx->nb_streams > nb_streams) {
             REALLOCZ_ARRAY_STREAM(nb_streams_frames,  nb_streams, fmt_ctx->nb_streams);
             REALLOCZ_ARRAY_STREAM(nb_streams_packets, nb_streams, fmt_ctx->nb_streams);
@@ -3318,6 +3346,8 @@ static int open_input_file(InputFile *ifile, const char *filename,
     fmt_ctx = avformat_alloc_context();
     if (!fmt_ctx)
         report_and_exit(AVERROR(ENOMEM));
+    fmt_ctx->interrupt_callback.callback = fftools_interrupt_callback;
+    fmt_ctx->interrupt_callback.opaque   = session;
 
     if (!av_dict_get(format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE)) {
         av_dict_set(&format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
@@ -3404,6 +3434,10 @@ static int open_input_file(InputFile *ifile, const char *filename,
 
             ist->dec_ctx->pkt_timebase = stream->time_base;
 
+            ist->dec_ctx->opaque = ist;
+            fftools_register_log_context(ist->dec_ctx);
+            fftools_register_log_context(ist);
+
             if (avcodec_open2(ist->dec_ctx, codec, &opts) < 0) {
                 av_log(NULL, AV_LOG_WARNING, "Could not open codec for input stream %d\n",
                        stream->index);
@@ -3424,11 +3458,18 @@ static int open_input_file(InputFile *ifile, const char *filename,
 
 static void close_input_file(InputFile *ifile)
 {
+    FFToolsInputSummary *acc = fftools_summary_input(0);
     int i;
 
+    if (acc && ifile->fmt_ctx && ifile->fmt_ctx->pb)
+        acc->bytes_read = ifile->fmt_ctx->pb->bytes_read;
+
     /* close decoder for each stream */
-    for (i = 0; i < ifile->nb_streams; i++)
+    for (i = 0; i < ifile->nb_streams; i++) {
+        fftools_unregister_log_context(ifile->streams[i].dec_ctx);
+        fftools_unregister_log_context(&ifile->streams[i]);
         avcodec_free_context(&ifile->streams[i].dec_ctx);
+    }
 
     av_freep(&ifile->streams);
     ifile->nb_streams = 0;
@@ -4000,6 +4041,8 @@ static inline int check_section_show_entries(int section_id)
     } while (0)
 
 void ffprobe_var_cleanup() {
+    cmdutils_var_cleanup();
+
     main_ffprobe_return_code = 0;
     longjmp_value = 0;
 
@@ -4036,6 +4079,7 @@ void ffprobe_var_cleanup() {
     use_byte_value_binary_prefix = 0;
     use_value_sexagesimal_format = 0;
     show_private_data            = 1;
+    show_optional_fields         = SHOW_OPTIONAL_FIELDS_AUTO;
 
     print_format = NULL;
     stream_specifier = NULL;
@@ -4048,6 +4092,7 @@ void ffprobe_var_cleanup() {
     input_filename = NULL;
     print_input_filename = NULL;
     iformat = NULL;
+    output_filename = NULL;
 
     hash = NULL;
 
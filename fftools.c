@@ -6,10 +6,27 @@
 #include <sys/stat.h>
 
 #include "config.h"
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 #include "libavutil/bprint.h"
+#include "libavutil/cpu.h"
 #include "libavutil/file.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
 #include "ffmpeg.h"
-#include "thread_queue.h"
+#include "log_arena.h"
+#include "ptr_map.h"
+#include "ring_queue.h"
+#include "thread_pool.h"
 #include "fftools.h"
 
 int printf_stderr(const char* fmt, ...) {
@@ -37,6 +54,252 @@ __thread FFToolsSession* session;
 /** Holds the default log level */
 int configuredLogLevel = AV_LOG_INFO;
 
+/** Number of log/statistics messages buffered when the config leaves it unset */
+#define FFTOOLS_DEFAULT_QUEUE_SIZE 64
+
+/** Largest batch handed to log_batch_callback when the config leaves it unset */
+#define FFTOOLS_DEFAULT_LOG_BATCH_SIZE 64
+
+/** Size of the chunks log text is copied into on its way to the calling thread */
+#define FFTOOLS_LOG_ARENA_CHUNK_SIZE (64 * 1024)
+
+/** Number of contexts of all running sessions whose log lines can be routed */
+#define FFTOOLS_LOG_OWNERS_SIZE 4096
+
+/** Number of parked worker threads kept alive between executions */
+#define FFTOOLS_DEFAULT_MAX_IDLE_THREADS 4
+
+static ThreadPool *thread_pool;
+static AVOnce thread_pool_once = AV_ONCE_INIT;
+
+static void thread_pool_init(void) {
+    thread_pool = tp_alloc(FFTOOLS_DEFAULT_MAX_IDLE_THREADS);
+}
+
+ThreadPool *fftools_thread_pool(void) {
+    ff_thread_once(&thread_pool_once, thread_pool_init);
+    return thread_pool;
+}
+
+void fftools_set_max_idle_threads(unsigned int max_idle) {
+    ThreadPool *tp = fftools_thread_pool();
+    if (tp) {
+        tp_set_max_idle(tp, max_idle);
+    }
+}
+
+/** Most threads handed to one context, beyond which libavcodec warns and gains little */
+#define FFTOOLS_MAX_CONTEXT_THREADS 16
+
+/** Codec and filter threads shared by the running sessions, 0 for the number of cores */
+static atomic_uint thread_budget;
+static atomic_int nb_running_sessions;
+
+void fftools_set_thread_budget(unsigned int nb_threads) {
+    atomic_store(&thread_budget, nb_threads);
+}
+
+int fftools_thread_budget(void) {
+    int budget = atomic_load(&thread_budget);
+    int nb_sessions = FFMAX(atomic_load(&nb_running_sessions), 1);
+    if (!budget) {
+        budget = av_cpu_count();
+    }
+    // Round to nearest, slightly oversubscribing the cores rather than leaving one idle
+    return av_clip((budget + nb_sessions / 2) / nb_sessions, 1, FFTOOLS_MAX_CONTEXT_THREADS);
+}
+
+/**
+ * Maps contexts that log from libav's own threads, which have no session, to
+ * the session that created them.
+ */
+static PtrMap *log_owners;
+static AVOnce log_owners_once = AV_ONCE_INIT;
+
+static void log_owners_init(void) {
+    log_owners = pm_alloc(FFTOOLS_LOG_OWNERS_SIZE);
+}
+
+static PtrMap *get_log_owners(void) {
+    ff_thread_once(&log_owners_once, log_owners_init);
+    return log_owners;
+}
+
+void fftools_register_log_context(const void *ctx) {
+    PtrMap *owners = get_log_owners();
+    if (session && owners && ctx && pm_set(owners, ctx, session) < 0) {
+        printf_stderr("Too many log contexts to register %p, its messages from other threads will be lost\n", ctx);
+    }
+}
+
+void fftools_unregister_log_context(const void *ctx) {
+    PtrMap *owners = get_log_owners();
+    if (owners && ctx) {
+        pm_remove(owners, ctx);
+    }
+}
+
+int fftools_cancel_requested(void) {
+    return session && atomic_load_explicit(&session->cancel_requested, memory_order_relaxed);
+}
+
+int fftools_interrupt_callback(void *opaque) {
+    FFToolsSession* s = opaque;
+    return s && atomic_load_explicit(&s->cancel_requested, memory_order_relaxed);
+}
+
+void fftools_input_signal(FFToolsSession *s) {
+    atomic_fetch_add(&s->input_seq, 1);
+    // Pairs with the store in fftools_input_wait(): either the waiter sees the
+    // new count, or it is waiting and gets woken up
+    if (atomic_load(&s->input_waiting)) {
+        pthread_mutex_lock(&s->input_lock);
+        pthread_cond_broadcast(&s->input_cond);
+        pthread_mutex_unlock(&s->input_lock);
+    }
+}
+
+unsigned fftools_input_seq(void) {
+    return atomic_load(&session->input_seq);
+}
+
+void fftools_input_wait(unsigned seq, int64_t timeout_us) {
+    FFToolsSession* s = session;
+    struct timespec abstime;
+    // pthread_cond_timedwait() takes a wall-clock deadline
+    int64_t t = av_gettime() + timeout_us;
+    abstime.tv_sec = t / 1000000;
+    abstime.tv_nsec = (t % 1000000) * 1000;
+
+    pthread_mutex_lock(&s->input_lock);
+    atomic_store(&s->input_waiting, 1);
+    while (atomic_load(&s->input_seq) == seq) {
+        if (pthread_cond_timedwait(&s->input_cond, &s->input_lock, &abstime)) {
+            break;
+        }
+    }
+    atomic_store(&s->input_waiting, 0);
+    pthread_mutex_unlock(&s->input_lock);
+}
+
+int64_t fftools_thread_cpu_time(void) {
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return -1;
+    }
+    return (((int64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+            ((int64_t)user.dwHighDateTime << 32 | user.dwLowDateTime)) / 10;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+        return -1;
+    }
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#else
+    return -1;
+#endif
+}
+
+/** Peak resident set size of the process in bytes, -1 if unknown. */
+static int64_t peak_rss(void) {
+#if defined(_WIN32)
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return -1;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss;
+#else
+    return (int64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+FFToolsInputSummary* fftools_summary_input(int index) {
+    FFToolsSessionSummary* summary = session ? session->summary : NULL;
+    if (!summary || index < 0) {
+        return NULL;
+    }
+    if (index >= summary->nb_inputs) {
+        FFToolsInputSummary* inputs = av_realloc_array(summary->inputs, index + 1, sizeof(*inputs));
+        if (!inputs) {
+            return NULL;
+        }
+        for (int i = summary->nb_inputs; i <= index; i++) {
+            memset(&inputs[i], 0, sizeof(inputs[i]));
+            inputs[i].bytes_read = -1;
+            inputs[i].cpu_time = -1;
+        }
+        summary->inputs = inputs;
+        summary->nb_inputs = index + 1;
+    }
+    return &summary->inputs[index];
+}
+
+FFToolsOutputSummary* fftools_summary_output(int index) {
+    FFToolsSessionSummary* summary = session ? session->summary : NULL;
+    if (!summary || index < 0) {
+        return NULL;
+    }
+    if (index >= summary->nb_outputs) {
+        FFToolsOutputSummary* outputs = av_realloc_array(summary->outputs, index + 1, sizeof(*outputs));
+        if (!outputs) {
+            return NULL;
+        }
+        for (int i = summary->nb_outputs; i <= index; i++) {
+            memset(&outputs[i], 0, sizeof(outputs[i]));
+            outputs[i].bytes_written = -1;
+            outputs[i].cpu_time = -1;
+        }
+        summary->outputs = outputs;
+        summary->nb_outputs = index + 1;
+    }
+    return &summary->outputs[index];
+}
+
+AVBPrint* fftools_output_buffer(void) {
+    return session && session->capture_output ? &session->output : NULL;
+}
+
+/**
+ * Finds the session owning a context logging from a thread without one. Codec
+ * frame threads log through copies of the registered context that keep its
+ * opaque pointer, filter threads through the filters of a registered graph.
+ */
+static FFToolsSession* find_log_session(void *avcl) {
+    PtrMap *owners = get_log_owners();
+    if (!owners) {
+        return NULL;
+    }
+    // Only a few levels of parents are ever used
+    for (int depth = 0; avcl && depth < 4; depth++) {
+        AVClass* avc = *(AVClass **) avcl;
+        FFToolsSession* s = pm_get(owners, avcl);
+        if (s) {
+            return s;
+        }
+        if (!avc) {
+            break;
+        }
+        if (avc == avcodec_get_class() && ((AVCodecContext *) avcl)->opaque) {
+            s = pm_get(owners, ((AVCodecContext *) avcl)->opaque);
+        } else if (avc == avfilter_get_class() && ((AVFilterContext *) avcl)->graph) {
+            s = pm_get(owners, ((AVFilterContext *) avcl)->graph);
+        }
+        if (s) {
+            return s;
+        }
+        if (!avc->parent_log_context_offset) {
+            break;
+        }
+        avcl = *(void **) (((uint8_t *) avcl) + avc->parent_log_context_offset);
+    }
+    return NULL;
+}
+
 /** Forward declaration for function defined in ffmpeg.c */
 int ffmpeg_execute(int argc, char **argv);
 /** Forward declaration for function defined in ffprobe.c */
@@ -44,6 +307,7 @@ int ffprobe_execute(int argc, char **argv);
 
 void fftools_log_callback_function(void *ptr, int level, const char* format, va_list vargs);
 static void fftools_statistics_callback_function(int frameNumber, float fps, float quality, int64_t size, int time, double bitrate, double speed);
+static void fftools_output_statistics_callback_function(FFToolsOutputStatistics* outputs, int nb_outputs, FFToolsInputStatistics* inputs, int nb_inputs, int is_last);
 
 static const char *avutil_log_get_level_str(int level) {
     switch (level) {
@@ -70,52 +334,122 @@ static const char *avutil_log_get_level_str(int level) {
     }
 }
 
-static void avutil_log_format_line(void *avcl, int level, const char *fmt, va_list vl, AVBPrint part[4], int *print_prefix) {
-    int flags = av_log_get_flags();
+/**
+ * Formats the context prefix, level and message into line, in one pass over
+ * a single buffer instead of four parts concatenated afterwards.
+ */
+static void avutil_log_format_line(void *avcl, int level, const char *fmt, va_list vl, AVBPrint *line) {
     AVClass* avc = avcl ? *(AVClass **) avcl : NULL;
-    av_bprint_init(part+0, 0, 1);
-    av_bprint_init(part+1, 0, 1);
-    av_bprint_init(part+2, 0, 1);
-    av_bprint_init(part+3, 0, AV_BPRINT_SIZE_UNLIMITED);
 
-    if (*print_prefix && avc) {
+    if (avc) {
         if (avc->parent_log_context_offset) {
             AVClass** parent = *(AVClass ***) (((uint8_t *) avcl) +
                                    avc->parent_log_context_offset);
             if (parent && *parent) {
-                av_bprintf(part+0, "[%s @ %p] ",
+                av_bprintf(line, "[%s @ %p] ",
                          (*parent)->item_name(parent), parent);
             }
         }
-        av_bprintf(part+1, "[%s @ %p] ",
+        av_bprintf(line, "[%s @ %p] ",
                  avc->item_name(avcl), avcl);
     }
 
-    if (*print_prefix && (level > AV_LOG_QUIET) && (flags & AV_LOG_PRINT_LEVEL))
-        av_bprintf(part+2, "[%s] ", avutil_log_get_level_str(level));
+    if ((level > AV_LOG_QUIET) && (av_log_get_flags() & AV_LOG_PRINT_LEVEL))
+        av_bprintf(line, "[%s] ", avutil_log_get_level_str(level));
+
+    av_vbprintf(line, fmt, vl);
+}
+
+/** Context of a structured log line, see avutil_log_format_origin(). */
+typedef struct LogOrigin {
+    AVClassCategory category;
+    AVClassCategory parent_category;
+    /** Bytes taken by the NUL-terminated item and parent names in front of the text. */
+    size_t names_length;
+} LogOrigin;
+
+static AVClassCategory avutil_log_get_category(void *avcl) {
+    AVClass* avc = *(AVClass **) avcl;
+    return avc->get_category ? avc->get_category(avcl) : avc->category;
+}
+
+/**
+ * Writes the item and parent names of the logging context into line, each
+ * followed by a NUL and empty if there is none, instead of the prefix
+ * avutil_log_format_line() would render.
+ */
+static void avutil_log_format_origin(void *avcl, AVBPrint *line, LogOrigin *origin) {
+    AVClass* avc = avcl ? *(AVClass **) avcl : NULL;
+    AVClass** parent = NULL;
+
+    origin->category = AV_CLASS_CATEGORY_NA;
+    origin->parent_category = AV_CLASS_CATEGORY_NA;
 
-    av_vbprintf(part+3, fmt, vl);
+    if (avc) {
+        av_bprintf(line, "%s", avc->item_name(avcl));
+        origin->category = avutil_log_get_category(avcl);
+        if (avc->parent_log_context_offset) {
+            parent = *(AVClass ***) (((uint8_t *) avcl) +
+                         avc->parent_log_context_offset);
+        }
+    }
+    av_bprint_chars(line, 0, 1);
 
-    if(*part[0].str || *part[1].str || *part[2].str || *part[3].str) {
-        char lastc = part[3].len && part[3].len <= part[3].size ? part[3].str[part[3].len - 1] : 0;
-        *print_prefix = lastc == '\n' || lastc == '\r';
+    if (parent && *parent) {
+        av_bprintf(line, "%s", (*parent)->item_name(parent));
+        origin->parent_category = avutil_log_get_category(parent);
     }
+    av_bprint_chars(line, 0, 1);
+
+    origin->names_length = line->len;
 }
 
-static void avutil_log_sanitize(char *line) {
-    while(*line){
-        if(*line < 0x08 || (*line > 0x0D && *line < 0x20))
-            *line='?';
-        line++;
+/** Repeats byte b in every byte of a word. */
+#define LOG_BYTES(b) (~(uint64_t)0 / 0xff * (b))
+
+/**
+ * Replaces control characters other than \b, \t, \n, \v, \f and \r with '?'.
+ * Returns the length of the sanitized line, which ends at the first NUL.
+ *
+ * Whole words are checked for bytes below 0x20 at once, so only the tail from
+ * the first word holding one, mostly the trailing newline, is looked at bytewise.
+ */
+static size_t avutil_log_sanitize(char *line, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, line + i, 8);
+        if ((w - LOG_BYTES(0x20)) & ~w & LOG_BYTES(0x80)) {
+            break;
+        }
+    }
+    for (; i < len; i++) {
+        uint8_t c = line[i];
+        if (!c) {
+            return i;
+        }
+        if (c < 0x08 || (c > 0x0D && c < 0x20)) {
+            line[i] = '?';
+        }
     }
+    return len;
 }
 
 typedef struct ThreadMessage {
-    enum {THREADMESSAGE_LOG, THREADMESSAGE_STATS} type;
+    enum {THREADMESSAGE_LOG, THREADMESSAGE_STATS, THREADMESSAGE_OUTPUT_STATS} type;
     union {
         struct {
             int level;
             char* message;
+            size_t length;
+            /** Arena chunk holding message. */
+            LogArenaChunk* chunk;
+            /** Only filled in for structured logs; the names share message's chunk. */
+            const char* item_name;
+            const char* parent_name;
+            AVClassCategory category;
+            AVClassCategory parent_category;
+            int64_t timestamp;
         } log_val;
         struct {
             int frameNumber;
@@ -126,59 +460,303 @@ typedef struct ThreadMessage {
             double bitrate;
             double speed;
         } stats_val;
+        struct {
+            /** Followed by the stream and input records, freed with av_free(). */
+            FFToolsOutputStatistics* outputs;
+            int nb_outputs;
+            FFToolsInputStatistics* inputs;
+            int nb_inputs;
+            int is_last;
+        } output_stats_val;
     } data;
 } ThreadMessage;
 
-static void *alloc_threadmessage(void) {
-    return malloc(sizeof(ThreadMessage));
-}
-
 static void reset_threadmessage(void *obj) {
     ThreadMessage *obj_m = obj;
     // Don't bother freeing anything else, it will get overwritten later
     if (obj_m->type == THREADMESSAGE_LOG && obj_m->data.log_val.message) {
-        free(obj_m->data.log_val.message);
+        la_release(obj_m->data.log_val.chunk, 1);
         obj_m->data.log_val.message = NULL;
     }
+    if (obj_m->type == THREADMESSAGE_OUTPUT_STATS) {
+        av_freep(&obj_m->data.output_stats_val.outputs);
+    }
 }
 
-static void free_threadmessage(void **obj) {
-    ThreadMessage *obj_m = *obj;
-    if (obj_m->type == THREADMESSAGE_LOG && obj_m->data.log_val.message) {
-        free(obj_m->data.log_val.message);
+/** Upper bound for log text merged under FFTOOLS_OVERFLOW_COALESCE, beyond it messages are dropped */
+#define FFTOOLS_MAX_COALESCED_SIZE (64 * 1024)
+
+/**
+ * Fills msg with a log line copied into the session's arena; returns 0 on
+ * allocation failure. If origin is set, text starts with the context names.
+ */
+static int init_log_message(FFToolsSession* s, ThreadMessage* msg, int level, const char* text, size_t length, const LogOrigin* origin) {
+    char* copy = la_strndup(s->log_arena, text, length, &msg->data.log_val.chunk);
+    msg->type = THREADMESSAGE_LOG;
+    msg->data.log_val.message = copy;
+    if (!copy) {
+        return 0;
+    }
+    msg->data.log_val.level = level;
+    msg->data.log_val.length = length;
+    msg->data.log_val.item_name = NULL;
+    msg->data.log_val.parent_name = NULL;
+    msg->data.log_val.category = origin ? origin->category : AV_CLASS_CATEGORY_NA;
+    msg->data.log_val.parent_category = origin ? origin->parent_category : AV_CLASS_CATEGORY_NA;
+    msg->data.log_val.timestamp = s->structured_log ? av_gettime_relative() : 0;
+    if (origin) {
+        const char* parent_name = copy + strlen(copy) + 1;
+        msg->data.log_val.item_name = *copy ? copy : NULL;
+        msg->data.log_val.parent_name = *parent_name ? parent_name : NULL;
+        msg->data.log_val.message = copy + origin->names_length;
+        msg->data.log_val.length = length - origin->names_length;
     }
-    free(obj_m);
+    return 1;
 }
 
-static void threadmessage_move(void *dst, void *src) {
-    ThreadMessage *dst_m = dst;
-    ThreadMessage *src_m = src;
-    dst_m->type = src_m->type;
-    if (src_m->type == THREADMESSAGE_LOG) {
-        dst_m->data.log_val.level = src_m->data.log_val.level;
-        dst_m->data.log_val.message = strdup(src_m->data.log_val.message);
+/**
+ * Creates the file descriptor that becomes readable when a receiver armed with
+ * arm_notification() has messages waiting. Without eventfd a pipe is used;
+ * on Windows there is none and receivers have to poll.
+ */
+static int notification_open(FFToolsSession* s) {
+#if defined(__linux__)
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        return AVERROR(errno);
     }
-    else {
-        dst_m->data.stats_val.bitrate = src_m->data.stats_val.bitrate;
-        dst_m->data.stats_val.fps = src_m->data.stats_val.fps;
-        dst_m->data.stats_val.frameNumber = src_m->data.stats_val.frameNumber;
-        dst_m->data.stats_val.quality = src_m->data.stats_val.quality;
-        dst_m->data.stats_val.size = src_m->data.stats_val.size;
-        dst_m->data.stats_val.speed = src_m->data.stats_val.speed;
-        dst_m->data.stats_val.time = src_m->data.stats_val.time;
+    s->notify_fd[0] = s->notify_fd[1] = fd;
+#elif !defined(_WIN32)
+    if (pipe(s->notify_fd) < 0) {
+        return AVERROR(errno);
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(s->notify_fd[i], F_SETFL, fcntl(s->notify_fd[i], F_GETFL) | O_NONBLOCK);
+        fcntl(s->notify_fd[i], F_SETFD, FD_CLOEXEC);
     }
+#endif
+    return 0;
 }
 
-void write_log_message_to_tq(int level, char* message) {
-    if (!session) {
+static void notification_close(FFToolsSession* s) {
+#ifndef _WIN32
+    if (s->notify_fd[1] >= 0 && s->notify_fd[1] != s->notify_fd[0]) {
+        close(s->notify_fd[1]);
+    }
+    if (s->notify_fd[0] >= 0) {
+        close(s->notify_fd[0]);
+    }
+#endif
+    s->notify_fd[0] = s->notify_fd[1] = -1;
+}
+
+/**
+ * Makes the notification descriptor readable, only if the receiver armed it
+ * unless force is set. Tool threads call this after every message, so the
+ * common case is a fence and a load.
+ */
+static void notify_receiver(FFToolsSession* s, int force) {
+    if (s->notify_fd[1] < 0) {
+        return;
+    }
+    if (!force) {
+        // Pairs with the fence in arm_notification(): either the receiver
+        // finds the message when checking again, or we see it armed
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!atomic_load_explicit(&s->notify_armed, memory_order_relaxed) ||
+            !atomic_exchange(&s->notify_armed, 0)) {
+            return;
+        }
+    }
+#ifndef _WIN32
+    uint64_t one = 1;
+    ssize_t ret = write(s->notify_fd[1], &one, s->notify_fd[0] == s->notify_fd[1] ? sizeof(one) : 1);
+    (void)ret; // a full pipe is readable already
+#endif
+}
+
+/** Called by the receiver once the queue is empty; it has to check the queue again afterwards. */
+static void arm_notification(FFToolsSession* s) {
+    if (s->notify_fd[0] < 0) {
+        return;
+    }
+    atomic_store_explicit(&s->notify_armed, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+/** Makes the notification descriptor unreadable again. */
+static void clear_notification(FFToolsSession* s) {
+#ifndef _WIN32
+    if (s->notify_fd[0] < 0) {
+        return;
+    }
+    if (s->notify_fd[0] == s->notify_fd[1]) {
+        // Reading an eventfd resets its counter
+        uint64_t count;
+        ssize_t ret = read(s->notify_fd[0], &count, sizeof(count));
+        (void)ret;
+    } else {
+        char buf[64];
+        while (read(s->notify_fd[0], buf, sizeof(buf)) > 0) {
+        }
+    }
+#endif
+}
+
+/** Queues msg, waiting for room if block is set, and wakes an armed receiver. */
+static int post_message(FFToolsSession* s, ThreadMessage* msg, int block) {
+    int ret = block ? rq_send(s->rq, msg) : rq_try_send(s->rq, msg);
+    if (ret >= 0) {
+        notify_receiver(s, 0);
+    }
+    return ret;
+}
+
+/** Program output and the final statistics are never dropped. */
+static int is_output_message(const void *elem) {
+    const ThreadMessage *msg = elem;
+    return (msg->type == THREADMESSAGE_LOG && msg->data.log_val.level == AV_LOG_STDERR) ||
+           (msg->type == THREADMESSAGE_OUTPUT_STATS && msg->data.output_stats_val.is_last);
+}
+
+/**
+ * Sends the messages merged while the queue was full, if any. Unless block is
+ * set, whatever does not fit stays pending.
+ */
+static void flush_coalesced(FFToolsSession* s, int block) {
+    if (!atomic_load_explicit(&s->coalesce_pending, memory_order_acquire)) {
+        return;
+    }
+    pthread_mutex_lock(&s->coalesce_lock);
+    if (s->coalesced_log.len) {
+        ThreadMessage msg;
+        int ret = !init_log_message(s, &msg, s->coalesced_log_level, s->coalesced_log.str, s->coalesced_log.len, NULL) ? AVERROR(ENOMEM) :
+                  post_message(s, &msg, block);
+        if (ret != AVERROR(EAGAIN)) {
+            if (ret < 0) {
+                reset_threadmessage(&msg);
+            }
+            av_bprint_clear(&s->coalesced_log);
+        } else {
+            reset_threadmessage(&msg);
+        }
+    }
+    if (s->has_coalesced_stats) {
+        ThreadMessage msg;
+        msg.type = THREADMESSAGE_STATS;
+        msg.data.stats_val.frameNumber = s->coalesced_stats.frameNumber;
+        msg.data.stats_val.fps = s->coalesced_stats.fps;
+        msg.data.stats_val.quality = s->coalesced_stats.quality;
+        msg.data.stats_val.size = s->coalesced_stats.size;
+        msg.data.stats_val.time = s->coalesced_stats.time;
+        msg.data.stats_val.bitrate = s->coalesced_stats.bitrate;
+        msg.data.stats_val.speed = s->coalesced_stats.speed;
+        int ret = post_message(s, &msg, block);
+        if (ret != AVERROR(EAGAIN)) {
+            s->has_coalesced_stats = 0;
+        }
+    }
+    atomic_store_explicit(&s->coalesce_pending, s->coalesced_log.len || s->has_coalesced_stats, memory_order_release);
+    pthread_mutex_unlock(&s->coalesce_lock);
+}
+
+/** Merges msg into the pending message; takes ownership of its contents. */
+static void coalesce_message(FFToolsSession* s, ThreadMessage* msg) {
+    pthread_mutex_lock(&s->coalesce_lock);
+    if (msg->type == THREADMESSAGE_LOG) {
+        size_t len = msg->data.log_val.length;
+        if (s->coalesced_log.len + len > FFTOOLS_MAX_COALESCED_SIZE) {
+            atomic_fetch_add_explicit(&s->nb_dropped, 1, memory_order_relaxed);
+        } else {
+            if (!s->coalesced_log.len || msg->data.log_val.level < s->coalesced_log_level) {
+                s->coalesced_log_level = msg->data.log_val.level;
+            }
+            av_bprint_append_data(&s->coalesced_log, msg->data.log_val.message, len);
+            atomic_fetch_add_explicit(&s->nb_coalesced, 1, memory_order_relaxed);
+        }
+    } else if (msg->type == THREADMESSAGE_OUTPUT_STATS) {
+        // Superseded by the next report anyway
+        atomic_fetch_add_explicit(&s->nb_dropped, 1, memory_order_relaxed);
+    } else {
+        if (s->has_coalesced_stats) {
+            atomic_fetch_add_explicit(&s->nb_coalesced, 1, memory_order_relaxed);
+        }
+        s->coalesced_stats.frameNumber = msg->data.stats_val.frameNumber;
+        s->coalesced_stats.fps = msg->data.stats_val.fps;
+        s->coalesced_stats.quality = msg->data.stats_val.quality;
+        s->coalesced_stats.size = msg->data.stats_val.size;
+        s->coalesced_stats.time = msg->data.stats_val.time;
+        s->coalesced_stats.bitrate = msg->data.stats_val.bitrate;
+        s->coalesced_stats.speed = msg->data.stats_val.speed;
+        s->has_coalesced_stats = 1;
+    }
+    atomic_store_explicit(&s->coalesce_pending, 1, memory_order_release);
+    pthread_mutex_unlock(&s->coalesce_lock);
+    reset_threadmessage(msg);
+}
+
+/**
+ * Queues msg for the calling thread, applying the session's overflow policy
+ * when the queue is full. Takes ownership of the message contents.
+ */
+static void send_message(FFToolsSession* s, ThreadMessage* msg) {
+    int ret;
+    if (s->overflow_policy == FFTOOLS_OVERFLOW_BLOCK || is_output_message(msg)) {
+        flush_coalesced(s, 1);
+        ret = post_message(s, msg, 1);
+    } else {
+        flush_coalesced(s, 0);
+        while ((ret = post_message(s, msg, 0)) == AVERROR(EAGAIN)) {
+            if (s->overflow_policy == FFTOOLS_OVERFLOW_DROP_NEWEST) {
+                atomic_fetch_add_explicit(&s->nb_dropped, 1, memory_order_relaxed);
+                reset_threadmessage(msg);
+                return;
+            } else if (s->overflow_policy == FFTOOLS_OVERFLOW_COALESCE) {
+                coalesce_message(s, msg);
+                return;
+            }
+            // FFTOOLS_OVERFLOW_DROP_OLDEST; program output must not be lost, nor
+            // moved behind newer messages, so wait instead when it is the oldest
+            ThreadMessage oldest;
+            if (rq_try_evict(s->rq, &oldest) < 0) {
+                ret = post_message(s, msg, 1);
+                break;
+            }
+            atomic_fetch_add_explicit(&s->nb_dropped, 1, memory_order_relaxed);
+            reset_threadmessage(&oldest);
+        }
+    }
+    if (ret < 0) {
+        reset_threadmessage(msg);
+    }
+}
+
+/** Sends whatever is still merged and reports the messages lost to overflow. */
+static void report_overflow(FFToolsSession* s) {
+    flush_coalesced(s, 1);
+    uint64_t dropped = atomic_load(&s->nb_dropped);
+    uint64_t coalesced = atomic_load(&s->nb_coalesced);
+    if (!dropped && !coalesced) {
+        return;
+    }
+    char line[256];
+    int len = snprintf(line, sizeof(line), "Log queue overflow: %"PRIu64" messages dropped, %"PRIu64" messages coalesced\n", dropped, coalesced);
+    ThreadMessage msg;
+    if (init_log_message(s, &msg, AV_LOG_WARNING, line, FFMIN(len, sizeof(line) - 1), NULL) && post_message(s, &msg, 1) < 0) {
+        reset_threadmessage(&msg);
+    }
+}
+
+static void write_log_message_to_tq(FFToolsSession* s, int level, const char* message, size_t length, const LogOrigin* origin) {
+    if (!s) {
         printf_stderr("No way to forward message with level %d and content %s\n", level, message);
         return;
     }
     ThreadMessage data;
-    data.type = THREADMESSAGE_LOG;
-    data.data.log_val.level = level;
-    data.data.log_val.message = message;
-    tq_send(session->tq, 0, &data); // TODO: Check return value
+    if (!init_log_message(s, &data, level, message, length, origin)) {
+        return;
+    }
+    send_message(s, &data);
 }
 
 void write_statistics_message_to_tq(int frameNumber, float fps, float quality, int64_t size, int time, double bitrate, double speed) {
@@ -195,145 +773,536 @@ void write_statistics_message_to_tq(int frameNumber, float fps, float quality, i
     data.data.stats_val.time = time;
     data.data.stats_val.bitrate = bitrate;
     data.data.stats_val.speed = speed;
-    tq_send(session->tq, 0, &data); // TODO: Check return value
+    send_message(session, &data);
+}
+
+void write_output_statistics_message_to_tq(FFToolsOutputStatistics* outputs, int nb_outputs, FFToolsInputStatistics* inputs, int nb_inputs, int is_last) {
+    if (!session) {
+        printf_stderr("No way to forward stats of %d outputs\n", nb_outputs);
+        av_free(outputs);
+        return;
+    }
+    ThreadMessage data;
+    data.type = THREADMESSAGE_OUTPUT_STATS;
+    data.data.output_stats_val.outputs = outputs;
+    data.data.output_stats_val.nb_outputs = nb_outputs;
+    data.data.output_stats_val.inputs = inputs;
+    data.data.output_stats_val.nb_inputs = nb_inputs;
+    data.data.output_stats_val.is_last = is_last;
+    send_message(session, &data);
+}
+
+void fftools_config_init(FFToolsConfig* config) {
+    memset(config, 0, sizeof(*config));
+    config->queue_size = FFTOOLS_DEFAULT_QUEUE_SIZE;
+    config->log_batch_max_records = FFTOOLS_DEFAULT_LOG_BATCH_SIZE;
+    config->log_level = configuredLogLevel;
+}
+
+int fftools_get_log_level(void) {
+    if (!session) {
+        return av_log_get_level();
+    }
+    return atomic_load_explicit(&session->log_level, memory_order_relaxed);
+}
+
+void fftools_set_log_level(int level) {
+    if (!session) {
+        av_log_set_level(level);
+        return;
+    }
+    atomic_store_explicit(&session->log_level, level, memory_order_relaxed);
 }
 
 typedef struct FFToolsArg {
     int argc;
     char **argv;
     FFToolsSession* session;
+    int ret;
+    /** CPU time of the pooled worker when the job started, which it keeps accumulating across jobs. */
+    int64_t start_cpu_time;
 } FFToolsArg;
 
-void *ffmpeg_thread(void *arg) {
-    FFToolsArg* toolsArg = arg;
-    session = toolsArg->session;
+/** Takes over the session on the pooled worker running the job. */
+static void start_job(FFToolsArg* toolsArg) {
+    FFToolsSession* s = toolsArg->session;
+    session = s;
+    atomic_fetch_add(&nb_running_sessions, 1);
+    if (s->summary) {
+        s->summary_start_time = av_gettime_relative();
+        s->summary_start_rss = peak_rss();
+        toolsArg->start_cpu_time = fftools_thread_cpu_time();
+    }
     av_log_set_callback(fftools_log_callback_function);
+}
+
+/**
+ * Ends a job running on a pooled worker. The argument and the session belong to
+ * the receiving thread, which frees them as soon as it sees the finish and
+ * takes finish_lock, so they must not be touched afterwards.
+ */
+static void finish_job(FFToolsArg* toolsArg, int ret) {
+    FFToolsSession* s = session;
+    if (s->summary) {
+        int64_t rss = peak_rss();
+        s->summary->wall_time = av_gettime_relative() - s->summary_start_time;
+        s->summary->cpu_time = fftools_thread_cpu_time();
+        s->summary->peak_rss_delta = rss >= 0 && s->summary_start_rss >= 0 ? rss - s->summary_start_rss : -1;
+        if (s->summary->cpu_time >= 0) {
+            s->summary->cpu_time -= toolsArg->start_cpu_time;
+        }
+    }
+    report_overflow(s);
+    atomic_fetch_sub(&nb_running_sessions, 1);
+    toolsArg->ret = ret;
+    session = NULL;
+    pthread_mutex_lock(&s->finish_lock);
+    rq_send_finish(s->rq);
+    notify_receiver(s, 1);
+    pthread_mutex_unlock(&s->finish_lock);
+}
+
+static void ffmpeg_job(void *arg) {
+    FFToolsArg* toolsArg = arg;
+    start_job(toolsArg);
     set_report_callback(fftools_statistics_callback_function);
-    int ret = ffmpeg_execute(toolsArg->argc, toolsArg->argv);
-    tq_send_finish(session->tq, 0);
-    return (void*)(intptr_t)ret;
+    set_output_report_callback(fftools_output_statistics_callback_function);
+    finish_job(toolsArg, ffmpeg_execute(toolsArg->argc, toolsArg->argv));
 }
 
-int ffmpeg_execute_with_callbacks(int argc, char **argv, session_callback_fp session_callback, log_callback_fp log_callback, statistics_callback_fp statistics_callback, void* user_data) {
-    FFToolsArg arg;
-    session = malloc(sizeof(FFToolsSession));
-    ObjPool *op = objpool_alloc(alloc_threadmessage, reset_threadmessage, free_threadmessage);
-    session->cancel_requested = 0;
-    session->tq = tq_alloc(1, 10, op, threadmessage_move); // TODO: Idk
-    arg.argc = argc;
-    arg.argv = argv;
-    arg.session = session;
-    if (session_callback) {
-        session_callback(session, user_data);
-    }
-    pthread_t thread;
-    pthread_create(&thread, NULL, ffmpeg_thread, (void*)&arg); // TODO: Check return value
-    while (1) {
-        ThreadMessage msg;
-        int stream_idx;
-        int tq_ret = tq_receive(session->tq, &stream_idx, &msg);
-        if (stream_idx < 0 || tq_ret == AVERROR_EOF) {
-            // End of data - conversion done
-            break;
+static void ffprobe_job(void *arg) {
+    FFToolsArg* toolsArg = arg;
+    start_job(toolsArg);
+    set_report_callback(fftools_statistics_callback_function);
+    finish_job(toolsArg, ffprobe_execute(toolsArg->argc, toolsArg->argv));
+}
+
+/** Log lines received but not handed to log_batch_callback yet. */
+typedef struct LogBatch {
+    FFToolsLogRecord* records;
+    ThreadMessage* messages;
+    int nb;
+    int max;
+} LogBatch;
+
+static int log_batch_init(LogBatch* batch, const FFToolsConfig* config) {
+    memset(batch, 0, sizeof(*batch));
+    if (!config->log_batch_callback) {
+        return 0;
+    }
+    batch->max = config->log_batch_max_records > 0 ? config->log_batch_max_records : FFTOOLS_DEFAULT_LOG_BATCH_SIZE;
+    batch->records = malloc(batch->max * sizeof(*batch->records));
+    batch->messages = malloc(batch->max * sizeof(*batch->messages));
+    if (!batch->records || !batch->messages) {
+        free(batch->records);
+        free(batch->messages);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+static void log_batch_flush(LogBatch* batch, const FFToolsConfig* config) {
+    if (!batch->nb) {
+        return;
+    }
+    config->log_batch_callback(batch->records, batch->nb, config->user_data);
+    // Release the lines in one go per arena chunk; consecutive lines mostly share one
+    for (int i = 0; i < batch->nb;) {
+        LogArenaChunk* chunk = batch->messages[i].data.log_val.chunk;
+        int n = 1;
+        while (i + n < batch->nb && batch->messages[i + n].data.log_val.chunk == chunk) {
+            n++;
         }
-        if (msg.type == THREADMESSAGE_LOG) {
-            if (log_callback) {
-                log_callback(msg.data.log_val.level, msg.data.log_val.message, user_data);
+        la_release(chunk, n);
+        i += n;
+    }
+    batch->nb = 0;
+}
+
+static void log_batch_uninit(LogBatch* batch, const FFToolsConfig* config) {
+    if (config->log_batch_callback) {
+        log_batch_flush(batch, config);
+    }
+    free(batch->records);
+    free(batch->messages);
+}
+
+/** Hands a received message to the configured callbacks; takes ownership of its contents. */
+static void deliver_message(ThreadMessage* msg, LogBatch* batch, const FFToolsConfig* config) {
+    if (msg->type == THREADMESSAGE_LOG) {
+        if (config->log_batch_callback) {
+            FFToolsLogRecord* record = &batch->records[batch->nb];
+            batch->messages[batch->nb] = *msg;
+            record->level = msg->data.log_val.level;
+            record->message = msg->data.log_val.message;
+            record->length = msg->data.log_val.length;
+            record->item_name = msg->data.log_val.item_name;
+            record->parent_name = msg->data.log_val.parent_name;
+            record->category = msg->data.log_val.category;
+            record->parent_category = msg->data.log_val.parent_category;
+            record->timestamp = msg->data.log_val.timestamp;
+            if (++batch->nb == batch->max) {
+                log_batch_flush(batch, config);
             }
+            return;
         }
-        else if (statistics_callback) {
-            statistics_callback(msg.data.stats_val.frameNumber, msg.data.stats_val.fps, msg.data.stats_val.quality, msg.data.stats_val.size, msg.data.stats_val.time, msg.data.stats_val.bitrate, msg.data.stats_val.speed, user_data);
+        if (config->log_callback) {
+            config->log_callback(msg->data.log_val.level, msg->data.log_val.message, config->user_data);
         }
-        reset_threadmessage(&msg);
     }
-    void* ret;
-    pthread_join(thread, &ret); // TODO: Check return value
-    tq_free(&session->tq);
-    free(session);
-    return (int)(intptr_t)ret;
+    else {
+        // Keep the log lines that came before these statistics in order
+        if (config->log_batch_callback) {
+            log_batch_flush(batch, config);
+        }
+        if (msg->type == THREADMESSAGE_OUTPUT_STATS) {
+            if (config->output_statistics_callback) {
+                config->output_statistics_callback(msg->data.output_stats_val.outputs, msg->data.output_stats_val.nb_outputs, msg->data.output_stats_val.is_last, config->user_data);
+            }
+            if (config->input_statistics_callback) {
+                config->input_statistics_callback(msg->data.output_stats_val.inputs, msg->data.output_stats_val.nb_inputs, msg->data.output_stats_val.is_last, config->user_data);
+            }
+        } else if (config->statistics_callback) {
+            config->statistics_callback(msg->data.stats_val.frameNumber, msg->data.stats_val.fps, msg->data.stats_val.quality, msg->data.stats_val.size, msg->data.stats_val.time, msg->data.stats_val.bitrate, msg->data.stats_val.speed, config->user_data);
+        }
+    }
+    reset_threadmessage(msg);
 }
 
-void *ffprobe_thread(void *arg) {
-    FFToolsArg* toolsArg = arg;
-    session = toolsArg->session;
-    av_log_set_callback(fftools_log_callback_function);
-    set_report_callback(fftools_statistics_callback_function);
-    int ret = ffprobe_execute(toolsArg->argc, toolsArg->argv);
-    tq_send_finish(session->tq, 0);
-    return (void*)(intptr_t)ret;
+/** State of the receiving side of a session. */
+typedef struct FFToolsJob {
+    FFToolsArg arg;
+    FFToolsConfig config;
+    LogBatch batch;
+    int64_t batch_latency;
+    int64_t batch_deadline;
+    /** Set once the end of the messages was received. */
+    int done;
+} FFToolsJob;
+
+static void free_session(FFToolsSession* s) {
+    // The job may still be in finish_job() after the last message
+    pthread_mutex_lock(&s->finish_lock);
+    pthread_mutex_unlock(&s->finish_lock);
+    PtrMap *owners = get_log_owners();
+    if (owners) {
+        pm_remove_value(owners, s);
+    }
+    if (s->job) {
+        log_batch_uninit(&s->job->batch, &s->job->config);
+        free(s->job);
+    }
+    if (s->capture_output) {
+        av_bprint_finalize(&s->output, NULL);
+    }
+    if (s->summary) {
+        av_free(s->summary->inputs);
+        av_free(s->summary->outputs);
+        av_free(s->summary);
+    }
+    rq_free(&s->rq);
+    la_free(&s->log_arena);
+    notification_close(s);
+    pthread_mutex_destroy(&s->finish_lock);
+    pthread_mutex_destroy(&s->coalesce_lock);
+    pthread_mutex_destroy(&s->input_lock);
+    pthread_cond_destroy(&s->input_cond);
+    av_bprint_finalize(&s->coalesced_log, NULL);
+    free(s);
 }
 
-int ffprobe_execute_with_callbacks(int argc, char **argv, session_callback_fp session_callback, log_callback_fp log_callback, void* user_data) {
-    FFToolsArg arg;
-    session = malloc(sizeof(FFToolsSession));
-    ObjPool *op = objpool_alloc(alloc_threadmessage, reset_threadmessage, free_threadmessage);
-    session->cancel_requested = 0;
-    session->tq = tq_alloc(1, 10, op, threadmessage_move); // TODO: Idk
-    arg.argc = argc;
-    arg.argv = argv;
-    arg.session = session;
-    if (session_callback) {
-        session_callback(session, user_data);
-    }
-    pthread_t thread;
-    pthread_create(&thread, NULL, ffprobe_thread, (void*)&arg); // TODO: Check return value
+static int submit_with_config(void (*job_func)(void *arg), int argc, char **argv, const FFToolsConfig* config, int notify, FFToolsSession** session_out) {
+    *session_out = NULL;
+    ThreadPool* tp = fftools_thread_pool();
+    if (!tp) {
+        return AVERROR(ENOMEM);
+    }
+    FFToolsSession* s = calloc(1, sizeof(FFToolsSession));
+    if (!s) {
+        return AVERROR(ENOMEM);
+    }
+    atomic_init(&s->refs, 1);
+    atomic_init(&s->cancel_requested, 0);
+    s->overflow_policy = config->overflow_policy;
+    s->structured_log = config->structured_log && config->log_batch_callback;
+    s->output_statistics = config->output_statistics_callback != NULL;
+    s->input_statistics = config->input_statistics_callback != NULL;
+    s->stats_interval_ms = config->stats_interval_ms;
+    s->stats_interval_frames = config->stats_interval_frames;
+    atomic_init(&s->log_level, config->log_level);
+    atomic_init(&s->notify_armed, 0);
+    s->notify_fd[0] = s->notify_fd[1] = -1;
+    pthread_mutex_init(&s->finish_lock, NULL);
+    pthread_mutex_init(&s->coalesce_lock, NULL);
+    pthread_mutex_init(&s->input_lock, NULL);
+    pthread_cond_init(&s->input_cond, NULL);
+    atomic_init(&s->input_seq, 0);
+    atomic_init(&s->input_waiting, 0);
+    av_bprint_init(&s->coalesced_log, 0, AV_BPRINT_SIZE_UNLIMITED);
+    s->log_arena = la_alloc(FFTOOLS_LOG_ARENA_CHUNK_SIZE);
+    s->rq = rq_alloc(config->queue_size > 0 ? config->queue_size : FFTOOLS_DEFAULT_QUEUE_SIZE, sizeof(ThreadMessage), reset_threadmessage);
+    if (s->rq) {
+        rq_set_pinned(s->rq, is_output_message);
+    }
+    if (config->summary_callback) {
+        s->summary = av_mallocz(sizeof(*s->summary));
+    }
+    if (config->output_callback) {
+        s->capture_output = 1;
+        av_bprint_init(&s->output, 0, AV_BPRINT_SIZE_UNLIMITED);
+    }
+    if (!s->log_arena || !s->rq || (config->summary_callback && !s->summary)) {
+        free_session(s);
+        return AVERROR(ENOMEM);
+    }
+    int ret = notify ? notification_open(s) : 0;
+    if (ret < 0) {
+        free_session(s);
+        return ret;
+    }
+    FFToolsJob* job = calloc(1, sizeof(FFToolsJob));
+    if (!job) {
+        free_session(s);
+        return AVERROR(ENOMEM);
+    }
+    job->config = *config;
+    job->arg.argc = argc;
+    job->arg.argv = argv;
+    job->arg.session = s;
+    job->batch_latency = (int64_t)FFMAX(config->log_batch_max_latency_ms, 0) * 1000;
+    ret = log_batch_init(&job->batch, config);
+    if (ret < 0) {
+        free(job);
+        free_session(s);
+        return ret;
+    }
+    s->job = job;
+    if (config->session_callback) {
+        config->session_callback(s, config->user_data);
+    }
+    ret = tp_submit(tp, job_func, &job->arg);
+    if (ret < 0) {
+        printf_stderr("Failed to start job with error %d\n", ret);
+        // The session callback may have taken a reference of its own
+        fftools_session_unref(s);
+        return ret;
+    }
+    *session_out = s;
+    return 0;
+}
+
+static void receive_message(FFToolsSession* s, ThreadMessage* msg) {
+    FFToolsJob* job = s->job;
+    if (!job->batch.nb) {
+        job->batch_deadline = av_gettime_relative() + job->batch_latency;
+    }
+    deliver_message(msg, &job->batch, &job->config);
+}
+
+/** Delivers what is left once the job sent its last message. */
+static void end_of_messages(FFToolsSession* s) {
+    FFToolsJob* job = s->job;
+    job->done = 1;
+    if (job->config.log_batch_callback) {
+        log_batch_flush(&job->batch, &job->config);
+    }
+    if (s->capture_output) {
+        char* data;
+        size_t size = s->output.len;
+        if (!av_bprint_is_complete(&s->output)) {
+            printf_stderr("Output of %u bytes could not be stored\n", s->output.len);
+            av_bprint_finalize(&s->output, NULL);
+        } else if (av_bprint_finalize(&s->output, &data) < 0) {
+            printf_stderr("Failed to hand over output of %zu bytes\n", size);
+        } else {
+            job->config.output_callback(data, size, job->config.user_data);
+        }
+        s->capture_output = 0;
+    }
+    if (s->summary && job->config.summary_callback) {
+        job->config.summary_callback(s->summary, job->config.user_data);
+    }
+}
+
+/**
+ * Delivers every queued message, waiting up to timeout_us for the first one.
+ * Pending log batches are delivered as well, without waiting for more lines.
+ */
+static int receive_available(FFToolsSession* s, int64_t timeout_us) {
+    FFToolsJob* job = s->job;
+    ThreadMessage msg;
+    int ret;
+
+    if (job->done) {
+        return AVERROR_EOF;
+    }
+    clear_notification(s);
+    ret = rq_receive_timeout(s->rq, &msg, timeout_us);
     while (1) {
+        if (ret == AVERROR(EAGAIN)) {
+            // Have the next message signalled, then look again in case it
+            // was sent before arming
+            arm_notification(s);
+            ret = rq_try_receive(s->rq, &msg);
+            if (ret == AVERROR(EAGAIN)) {
+                break;
+            }
+        }
+        if (ret < 0) {
+            end_of_messages(s);
+            break;
+        }
+        receive_message(s, &msg);
+        ret = rq_try_receive(s->rq, &msg);
+    }
+    if (job->config.log_batch_callback) {
+        log_batch_flush(&job->batch, &job->config);
+    }
+    return job->done ? AVERROR_EOF : 0;
+}
+
+int ffmpeg_submit_with_config(int argc, char **argv, const FFToolsConfig* config, FFToolsSession** session) {
+    return submit_with_config(ffmpeg_job, argc, argv, config, 1, session);
+}
+
+int ffprobe_submit_with_config(int argc, char **argv, const FFToolsConfig* config, FFToolsSession** session) {
+    return submit_with_config(ffprobe_job, argc, argv, config, 1, session);
+}
+
+int fftools_session_get_fd(FFToolsSession* session) {
+    return session->notify_fd[0] >= 0 ? session->notify_fd[0] : AVERROR(ENOSYS);
+}
+
+int fftools_session_try_receive(FFToolsSession* session) {
+    return receive_available(session, 0);
+}
+
+int fftools_session_receive_timeout(FFToolsSession* session, int timeout_ms) {
+    return receive_available(session, (int64_t)FFMAX(timeout_ms, 0) * 1000);
+}
+
+void fftools_session_cancel(FFToolsSession* session) {
+    atomic_store(&session->cancel_requested, 1);
+    // Do not leave the main loop waiting for input
+    fftools_input_signal(session);
+}
+
+int fftools_session_join(FFToolsSession* session) {
+    FFToolsJob* job = session->job;
+    while (!job->done) {
         ThreadMessage msg;
-        int stream_idx;
-        int tq_ret = tq_receive(session->tq, &stream_idx, &msg);
-        if (stream_idx < 0 || tq_ret == AVERROR_EOF) {
+        int ret;
+        if (!job->batch.nb) {
+            ret = rq_receive(session->rq, &msg);
+        } else {
+            // Drain what is queued, then wait for stragglers until the batch is due
+            ret = rq_receive_timeout(session->rq, &msg, job->batch_deadline - av_gettime_relative());
+            if (ret == AVERROR(EAGAIN)) {
+                log_batch_flush(&job->batch, &job->config);
+                continue;
+            }
+        }
+        if (ret < 0) {
             // End of data - conversion done
+            end_of_messages(session);
             break;
         }
-        if (msg.type == THREADMESSAGE_LOG && log_callback) {
-            log_callback(msg.data.log_val.level, msg.data.log_val.message, user_data);
-        }
-        reset_threadmessage(&msg);
+        receive_message(session, &msg);
     }
-    void* ret;
-    pthread_join(thread, &ret); // TODO: Check return value
-    tq_free(&session->tq);
-    free(session);
-    return (int)(intptr_t)ret;
+    int ret = job->arg.ret;
+    fftools_session_unref(session);
+    return ret;
+}
+
+void fftools_session_ref(FFToolsSession* session) {
+    atomic_fetch_add_explicit(&session->refs, 1, memory_order_relaxed);
+}
+
+void fftools_session_unref(FFToolsSession* session) {
+    if (atomic_fetch_sub_explicit(&session->refs, 1, memory_order_acq_rel) == 1) {
+        free_session(session);
+    }
+}
+
+static int execute_with_config(void (*job_func)(void *arg), int argc, char **argv, const FFToolsConfig* config) {
+    FFToolsSession* s;
+    int ret = submit_with_config(job_func, argc, argv, config, 0, &s);
+    if (ret < 0) {
+        return ret;
+    }
+    return fftools_session_join(s);
+}
+
+int ffmpeg_execute_with_config(int argc, char **argv, const FFToolsConfig* config) {
+    return execute_with_config(ffmpeg_job, argc, argv, config);
+}
+
+int ffprobe_execute_with_config(int argc, char **argv, const FFToolsConfig* config) {
+    return execute_with_config(ffprobe_job, argc, argv, config);
+}
+
+int ffmpeg_execute_with_callbacks(int argc, char **argv, session_callback_fp session_callback, log_callback_fp log_callback, statistics_callback_fp statistics_callback, void* user_data) {
+    FFToolsConfig config;
+    fftools_config_init(&config);
+    config.session_callback = session_callback;
+    config.log_callback = log_callback;
+    config.statistics_callback = statistics_callback;
+    config.user_data = user_data;
+    return ffmpeg_execute_with_config(argc, argv, &config);
+}
+
+int ffprobe_execute_with_callbacks(int argc, char **argv, session_callback_fp session_callback, log_callback_fp log_callback, void* user_data) {
+    FFToolsConfig config;
+    fftools_config_init(&config);
+    config.session_callback = session_callback;
+    config.log_callback = log_callback;
+    config.user_data = user_data;
+    return ffprobe_execute_with_config(argc, argv, &config);
 }
 
 void fftools_log_callback_function(void *ptr, int level, const char* format, va_list vargs) {
-    AVBPrint fullLine;
-    AVBPrint part[4];
-    int print_prefix = 1;
+    AVBPrint line;
 
     if (level >= 0) {
         level &= 0xff;
     }
-    int activeLogLevel = av_log_get_level();
+    // Lines from libav's own threads belong to whichever session owns the context
+    FFToolsSession* s = session ? session : find_log_session(ptr);
+    int activeLogLevel = s ? atomic_load_explicit(&s->log_level, memory_order_relaxed) : av_log_get_level();
 
     // AV_LOG_STDERR logs are always redirected
     if ((activeLogLevel == AV_LOG_QUIET && level != AV_LOG_STDERR) || (level > activeLogLevel)) {
         return;
     }
 
-    av_bprint_init(&fullLine, 0, AV_BPRINT_SIZE_UNLIMITED);
+    // The buffer embedded in AVBPrint lives on this thread's stack and fits
+    // typical lines, so only unusually long ones reach the heap
+    av_bprint_init(&line, 0, AV_BPRINT_SIZE_UNLIMITED);
 
-    avutil_log_format_line(ptr, level, format, vargs, part, &print_prefix);
-    avutil_log_sanitize(part[0].str);
-    avutil_log_sanitize(part[1].str);
-    avutil_log_sanitize(part[2].str);
-    avutil_log_sanitize(part[3].str);
-
-    // COMBINE ALL 4 LOG PARTS
-    av_bprintf(&fullLine, "%s%s%s%s", part[0].str, part[1].str, part[2].str, part[3].str);
+    // Structured lines carry the context separately and need no prefix
+    LogOrigin origin;
+    size_t names_length = 0;
+    if (s && s->structured_log) {
+        avutil_log_format_origin(ptr, &line, &origin);
+        names_length = origin.names_length;
+        av_vbprintf(&line, format, vargs);
+    } else {
+        avutil_log_format_line(ptr, level, format, vargs, &line);
+    }
 
-    if (fullLine.len > 0) {
-        write_log_message_to_tq(level, fullLine.str);
+    size_t end = FFMIN(line.len, line.size - 1);
+    size_t length = end > names_length ? avutil_log_sanitize(line.str + names_length, end - names_length) : 0;
+    if (length > 0) {
+        write_log_message_to_tq(s, level, line.str, names_length + length, names_length ? &origin : NULL);
     }
 
-    av_bprint_finalize(part, NULL);
-    av_bprint_finalize(part+1, NULL);
-    av_bprint_finalize(part+2, NULL);
-    av_bprint_finalize(part+3, NULL);
-    av_bprint_finalize(&fullLine, NULL);
+    av_bprint_finalize(&line, NULL);
 }
 
 static void fftools_statistics_callback_function(int frameNumber, float fps, float quality, int64_t size, int time, double bitrate, double speed) {
     write_statistics_message_to_tq(frameNumber, fps, quality, size, time, bitrate, speed);
 }
+
+static void fftools_output_statistics_callback_function(FFToolsOutputStatistics* outputs, int nb_outputs, FFToolsInputStatistics* inputs, int nb_inputs, int is_last) {
+    write_output_statistics_message_to_tq(outputs, nb_outputs, inputs, nb_inputs, is_last);
+}
@@ -2,9 +2,92 @@
 #define FFTOOLS_H
 
 #include "fftools_api.h"
+#include "thread_pool.h"
 
 extern __thread FFToolsSession* session;
 
 int printf_stderr(const char *fmt, ...);
 
+/**
+ * Returns the process-wide pool that executions run on, creating it on first
+ * use. Returns NULL if it could not be allocated.
+ */
+ThreadPool *fftools_thread_pool(void);
+
+/**
+ * Thread count for a codec context or filter graph of the session running on
+ * the calling thread that was given none: the thread budget split among the
+ * running sessions. Sessions starting later do not change the count of
+ * contexts opened already, it evens out as contexts are reopened and sessions
+ * come and go.
+ */
+int fftools_thread_budget(void);
+
+/**
+ * Log level of the session running on the calling thread. Threads without a
+ * session use the process-wide av_log level.
+ */
+int  fftools_get_log_level(void);
+void fftools_set_log_level(int level);
+
+/**
+ * Routes log lines of ctx, emitted from libav's own threads such as codec
+ * frame threads or filter threads, to the session running on the calling
+ * thread. Frame threads log through copies of the codec context, so register
+ * its opaque pointer as well.
+ */
+void fftools_register_log_context(const void *ctx);
+/**
+ * Stops routing log lines of ctx; call before freeing a registered context.
+ */
+void fftools_unregister_log_context(const void *ctx);
+
+/**
+ * Whether the session running on the calling thread was cancelled. Threads
+ * without a session are never cancelled.
+ */
+int  fftools_cancel_requested(void);
+/**
+ * AVIOInterruptCB callback aborting blocking I/O once the session passed as
+ * opaque is cancelled. Unlike fftools_cancel_requested() it works on any
+ * thread, including libav's own.
+ */
+int  fftools_interrupt_callback(void *session);
+
+/**
+ * Signals the main thread of session s that input became available: a
+ * packet was queued or an input ended. Called from demuxer threads.
+ */
+void     fftools_input_signal(FFToolsSession *s);
+/**
+ * Number of input signals of the session running on the calling thread so
+ * far, to be passed to fftools_input_wait().
+ */
+unsigned fftools_input_seq(void);
+/**
+ * Waits until the session running on the calling thread gets an input signal
+ * beyond seq, or at most timeout_us. Returns immediately if it got one
+ * already, so no signal sent after seq was read is missed.
+ */
+void     fftools_input_wait(unsigned seq, int64_t timeout_us);
+
+/**
+ * CPU time used by the calling thread so far in microseconds, -1 where not
+ * supported.
+ */
+int64_t fftools_thread_cpu_time(void);
+/**
+ * Accounting record of an input or output file of the session running on the
+ * calling thread, to be filled in when the file is closed. NULL unless a
+ * summary was requested, or on allocation failure.
+ */
+FFToolsInputSummary  *fftools_summary_input(int index);
+FFToolsOutputSummary *fftools_summary_output(int index);
+
+/**
+ * Buffer that program output of the session running on the calling thread is
+ * to be appended to rather than logged, NULL if it is to be logged.
+ */
+AVBPrint *fftools_output_buffer(void);
+
 #endif // FFTOOLS_H
@@ -2,31 +2,441 @@
 #define FFTOOLS_API_H
 
 #include "setjmp.h"
+#include "stdatomic.h"
 #include "stdint.h"
 #include "stdio.h"
 
+#include "libavutil/bprint.h"
+#include "libavutil/log.h"
+#include "libavutil/thread.h"
+
 #include "cmdutils.h"
-#include "thread_queue.h"
+#include "log_arena.h"
+#include "ring_queue.h"
+
+/**
+ * What the tool threads do with a log or statistics message when the queue to
+ * the calling thread is full. Program output (AV_LOG_STDERR, e.g. ffprobe's
+ * printed results) is never dropped or merged, whatever the policy.
+ */
+enum FFToolsOverflowPolicy {
+    /** Wait until the calling thread makes room. */
+    FFTOOLS_OVERFLOW_BLOCK = 0,
+    /** Discard the oldest queued message to make room for the new one. */
+    FFTOOLS_OVERFLOW_DROP_OLDEST = 1,
+    /** Discard the new message. */
+    FFTOOLS_OVERFLOW_DROP_NEWEST = 2,
+    /**
+     * Merge messages into a single pending one that is sent as soon as there
+     * is room again. Merged log text keeps the most severe level; only the
+     * latest statistics are kept.
+     */
+    FFTOOLS_OVERFLOW_COALESCE = 3
+};
 
 typedef struct FFToolsSession {
-    ThreadQueue *tq;
+    /** Carries log and statistics messages from the tool threads to the caller. */
+    RingQueue *rq;
+    /** Receiving side: callbacks, pending log batch and the job's result. */
+    struct FFToolsJob *job;
+    /**
+     * Read and write ends of the descriptor signalling queued messages to an
+     * asynchronous receiver, -1 if there is none. An eventfd uses the same
+     * descriptor for both.
+     */
+    int notify_fd[2];
+    /** Set by the receiver when it wants to be signalled the next message. */
+    atomic_int notify_armed;
+    /** Held while the job marks the end of its messages. */
+    pthread_mutex_t finish_lock;
+    /** Backs the text of queued log messages, released once delivered. */
+    LogArena *log_arena;
     /** Holds information to implement exception handling. */
     jmp_buf ex_buf__;
-    int cancel_requested;
+    /** References keeping the session allocated, see fftools_session_ref(). */
+    atomic_int refs;
+    /** Set by fftools_session_cancel(), from any thread. */
+    atomic_int cancel_requested;
     OptionDef *options;
+    /**
+     * Lines above this level are dropped before being formatted. Set from the
+     * config and by -loglevel, without touching the process-wide av_log level
+     * other sessions would see.
+     */
+    atomic_int log_level;
+
+    enum FFToolsOverflowPolicy overflow_policy;
+    /** Log lines are formatted without the context prefix, see FFToolsConfig.structured_log. */
+    int structured_log;
+    /** Per-output statistics are collected, see FFToolsConfig.output_statistics_callback. */
+    int output_statistics;
+    /** Per-input statistics are collected, see FFToolsConfig.input_statistics_callback. */
+    int input_statistics;
+    /** When statistics are reported, see FFToolsConfig.stats_interval_ms. */
+    int stats_interval_ms;
+    int stats_interval_frames;
+    /**
+     * Resources used by the execution, NULL unless requested with
+     * FFToolsConfig.summary_callback. Filled in by the tool thread and read
+     * by the receiver once the execution has finished.
+     */
+    struct FFToolsSessionSummary* summary;
+    /** Collects program output for FFToolsConfig.output_callback if capture_output is set. */
+    int capture_output;
+    AVBPrint output;
+    int64_t summary_start_time;
+    int64_t summary_start_rss;
+    /** Messages discarded or merged because the queue was full. */
+    atomic_uint_fast64_t nb_dropped;
+    atomic_uint_fast64_t nb_coalesced;
+    /** Messages merged under FFTOOLS_OVERFLOW_COALESCE and not sent yet. */
+    pthread_mutex_t coalesce_lock;
+    atomic_int coalesce_pending;
+    AVBPrint coalesced_log;
+    int coalesced_log_level;
+    int has_coalesced_stats;
+    struct {
+        int frameNumber;
+        float fps;
+        float quality;
+        int64_t size;
+        int time;
+        double bitrate;
+        double speed;
+    } coalesced_stats;
+    /**
+     * Wakes ffmpeg's main thread when a demuxer thread makes input available,
+     * see fftools_input_wait(). input_seq counts the signals so far.
+     */
+    pthread_mutex_t input_lock;
+    pthread_cond_t input_cond;
+    atomic_uint input_seq;
+    atomic_int input_waiting;
 } FFToolsSession;
 
 typedef void (*session_callback_fp)(FFToolsSession* session, void* user_data);
 typedef void (*log_callback_fp)(int level, char* message, void* user_data);
+/** One log line as delivered to log_batch_callback_fp. */
+typedef struct FFToolsLogRecord {
+    int level;
+    /** NUL-terminated; only valid for the duration of the callback. */
+    const char* message;
+    size_t length;
+    /**
+     * The fields below are only filled in with FFToolsConfig.structured_log,
+     * in which case message holds the text alone, without the context prefix.
+     * Names are NULL if there is no such context, and like message only valid
+     * for the duration of the callback.
+     */
+    const char* item_name;
+    const char* parent_name;
+    AVClassCategory category;
+    AVClassCategory parent_category;
+    /** av_gettime_relative() when the line was logged, in microseconds. */
+    int64_t timestamp;
+} FFToolsLogRecord;
+
+typedef void (*log_batch_callback_fp)(const FFToolsLogRecord* records, int nb_records, void* user_data);
 typedef void (*statistics_callback_fp)(int frameNumber, float fps, float quality, int64_t size, int time, double bitrate, double speed, void* user_data);
 
+/** Statistics of one output stream, as delivered to output_statistics_callback_fp. */
+typedef struct FFToolsStreamStatistics {
+    int file_index;
+    int stream_index;
+    /** enum AVMediaType of the stream. */
+    int type;
+    /** Frames sent to the encoder; 0 for streams copied without encoding. */
+    uint64_t frames_encoded;
+    /** Packets and bytes handed to the muxer. */
+    uint64_t packets_written;
+    uint64_t size;
+    /** Encoder quality of the last packet, -1 without encoder. */
+    float quality;
+    /** Frames duplicated and dropped to keep the output frame rate. */
+    int64_t frames_dup;
+    int64_t frames_drop;
+    /** Timestamp of the last packet handed to the muxer in milliseconds, -1 if none yet. */
+    int64_t time;
+    /** Frames encoded, or packets muxed when copying, per second of processing. */
+    double fps;
+    /** Stream duration produced per second of processing, -1 if unknown. */
+    double speed;
+} FFToolsStreamStatistics;
+
+/** Statistics of one output file, as delivered to output_statistics_callback_fp. */
+typedef struct FFToolsOutputStatistics {
+    int file_index;
+    /** Bytes written so far, -1 if unknown. */
+    int64_t size;
+    /** Timestamp of the last packet of any stream in milliseconds, -1 if none yet. */
+    int64_t time;
+    /** In kbit/s, -1 if unknown. */
+    double bitrate;
+    /** Duration produced per second of processing, -1 if unknown. */
+    double speed;
+    int nb_streams;
+    FFToolsStreamStatistics* streams;
+} FFToolsOutputStatistics;
+
+/**
+ * Called with one record per output file each time statistics are reported,
+ * is_last being set for the final report. The records are only valid for the
+ * duration of the callback.
+ */
+typedef void (*output_statistics_callback_fp)(const FFToolsOutputStatistics* outputs, int nb_outputs, int is_last, void* user_data);
+
+/** Statistics of one input file, as delivered to input_statistics_callback_fp. */
+typedef struct FFToolsInputStatistics {
+    int file_index;
+    /** Packets demuxed so far. */
+    uint64_t packets;
+    /**
+     * Packets waiting in the demuxer thread queue, the packets it is sized
+     * for, the most it held so far and how often its size was tuned, see
+     * -thread_queue_size.
+     */
+    int queue_depth;
+    int queue_size;
+    int max_queue_depth;
+    int queue_resizes;
+} FFToolsInputStatistics;
+
+/**
+ * Called with one record per input file each time statistics are reported,
+ * right after output_statistics_callback_fp, is_last being set for the final
+ * report. The records are only valid for the duration of the callback.
+ */
+typedef void (*input_statistics_callback_fp)(const FFToolsInputStatistics* inputs, int nb_inputs, int is_last, void* user_data);
+
+/** Resources used by one input file, see FFToolsSessionSummary. */
+typedef struct FFToolsInputSummary {
+    /** Bytes read from the input, -1 if unknown. */
+    int64_t bytes_read;
+    /** Packets demuxed; not counted by ffprobe. */
+    uint64_t packets;
+    /** Packets allocated for them, the others being reused; not counted by ffprobe. */
+    uint64_t packet_allocs;
+    /** CPU time of the demuxer thread in microseconds, -1 if unknown. */
+    int64_t cpu_time;
+    /** Time the demuxer thread waited for room in its queue, in microseconds. */
+    int64_t queue_full_time;
+    /** Time the main thread waited for packets from the demuxer thread, in microseconds. */
+    int64_t queue_empty_time;
+    /** Time the demuxer thread waited for input that was not ready yet, in microseconds. */
+    int64_t read_wait_time;
+    /**
+     * Packets the demuxer thread queue was last sized for, the most it held
+     * and how often the size was tuned, see -thread_queue_size.
+     */
+    int queue_size;
+    int max_queue_depth;
+    int queue_resizes;
+} FFToolsInputSummary;
+
+/** Resources used by one output file, see FFToolsSessionSummary. */
+typedef struct FFToolsOutputSummary {
+    /** Bytes written to the output, -1 if unknown. */
+    int64_t bytes_written;
+    uint64_t packets;
+    uint64_t frames_encoded;
+    /** CPU time of the muxer thread in microseconds, -1 if unknown. */
+    int64_t cpu_time;
+    /** Time the main thread waited for room in the muxer's queue, in microseconds. */
+    int64_t queue_full_time;
+    /** Time the muxer thread waited for packets, in microseconds. */
+    int64_t queue_empty_time;
+} FFToolsOutputSummary;
+
+/** Resources used by an execution, as delivered to summary_callback_fp. */
+typedef struct FFToolsSessionSummary {
+    /** Time from the start to the end of the execution in microseconds. */
+    int64_t wall_time;
+    /**
+     * CPU time of the thread running the execution in microseconds, -1 if
+     * unknown. Codec and filter threads are not accounted for.
+     */
+    int64_t cpu_time;
+    /**
+     * Growth of the peak resident set size of the process during the
+     * execution in bytes, -1 if unknown. Concurrent executions add up to it.
+     */
+    int64_t peak_rss_delta;
+    int nb_inputs;
+    FFToolsInputSummary* inputs;
+    int nb_outputs;
+    FFToolsOutputSummary* outputs;
+} FFToolsSessionSummary;
+
+/**
+ * Receives ffprobe's whole output at once, see FFToolsConfig.output_callback.
+ * The callback takes ownership of data, NUL-terminated after size bytes, and
+ * must free it with av_free().
+ */
+typedef void (*output_callback_fp)(char* data, size_t size, void* user_data);
+
+/**
+ * Called once the execution has finished, after all other messages. The
+ * summary is only valid for the duration of the callback.
+ */
+typedef void (*summary_callback_fp)(const FFToolsSessionSummary* summary, void* user_data);
+
+typedef struct FFToolsConfig {
+    session_callback_fp session_callback;
+    log_callback_fp log_callback;
+    statistics_callback_fp statistics_callback;
+    void* user_data;
+    /**
+     * Number of log/statistics messages buffered between the tool threads and
+     * the calling thread before the tool threads wait. Rounded up to a power
+     * of two; 0 selects the default.
+     */
+    int queue_size;
+    /**
+     * What to do when the queue is full, FFTOOLS_OVERFLOW_BLOCK by default.
+     * Unless blocking, a final warning reports how many messages were
+     * dropped or merged.
+     */
+    enum FFToolsOverflowPolicy overflow_policy;
+    /**
+     * If set, log lines are delivered through this callback in batches instead
+     * of through log_callback, one invocation per batch. A batch holds up to
+     * log_batch_max_records lines and is delivered once the queue is drained,
+     * after waiting at most log_batch_max_latency_ms for more lines to arrive.
+     * Statistics and the end of the execution flush the pending batch first.
+     */
+    log_batch_callback_fp log_batch_callback;
+    int log_batch_max_records;
+    int log_batch_max_latency_ms;
+    /**
+     * If set, ffmpeg additionally reports statistics per output file and
+     * stream through this callback, next to the summary passed to
+     * statistics_callback.
+     */
+    output_statistics_callback_fp output_statistics_callback;
+    /**
+     * If set together with log_batch_callback, records carry the logging
+     * context's names and categories and a timestamp, and the message is not
+     * prefixed with "[name @ 0x...]" or the level.
+     */
+    int structured_log;
+    /**
+     * Initial log level of the execution, AV_LOG_INFO by default. Options such
+     * as -loglevel change it for this execution only.
+     */
+    int log_level;
+    /**
+     * How often ffmpeg reports statistics: every stats_interval_ms of
+     * processing and every stats_interval_frames frames muxed for the first
+     * video stream (or the first stream without video), whichever comes first.
+     * An interval of 0 is not used; with both at 0, statistics follow
+     * -stats_period, every 500 ms by default. The final statistics are always
+     * reported.
+     */
+    int stats_interval_ms;
+    int stats_interval_frames;
+    /** If set, receives the resources used by the execution once it has finished. */
+    summary_callback_fp summary_callback;
+    /**
+     * If set, ffprobe writes the output it would print into a buffer that is
+     * handed to this callback once the execution has finished, before the
+     * summary, instead of sending it line by line as AV_LOG_STDERR log
+     * messages. Output written to a file with -o is not affected.
+     */
+    output_callback_fp output_callback;
+    /**
+     * If set, ffmpeg additionally reports statistics per input file through
+     * this callback, such as how full its demuxer thread queue is, each time
+     * statistics are reported.
+     */
+    input_statistics_callback_fp input_statistics_callback;
+} FFToolsConfig;
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
+/**
+ * Fills config with the defaults: no callbacks, the default queue size,
+ * blocking when the queue is full, batches of up to 64 log lines delivered
+ * without waiting for more and the AV_LOG_INFO log level.
+ */
+void fftools_config_init(FFToolsConfig* config);
+
+int ffmpeg_execute_with_config(int argc, char **argv, const FFToolsConfig* config);
+int ffprobe_execute_with_config(int argc, char **argv, const FFToolsConfig* config);
+
+/**
+ * Start an execution without waiting for it. Messages are delivered to the
+ * config's callbacks by fftools_session_try_receive(),
+ * fftools_session_receive_timeout() or fftools_session_join(), on the thread
+ * calling them, and at most one thread may call them at a time.
+ * log_batch_max_latency_ms only applies to fftools_session_join(); the other
+ * calls deliver pending batches before returning.
+ *
+ * @param session set to the handle of the execution, which must be passed to
+ *                fftools_session_join() eventually
+ * @return 0 on success, a negative AVERROR code otherwise
+ */
+int ffmpeg_submit_with_config(int argc, char **argv, const FFToolsConfig* config, FFToolsSession** session);
+int ffprobe_submit_with_config(int argc, char **argv, const FFToolsConfig* config, FFToolsSession** session);
+
+/**
+ * Returns a descriptor that becomes readable when messages or the end of the
+ * execution are waiting to be received, for use with poll() or an event loop.
+ * It stays readable until the next receive call, and is closed once the
+ * session is freed. Returns AVERROR(ENOSYS) where not supported.
+ */
+int fftools_session_get_fd(FFToolsSession* session);
+/**
+ * Deliver all queued messages without waiting.
+ *
+ * @return 0 while the execution is running, AVERROR_EOF once it has finished
+ *         and all its messages were delivered
+ */
+int fftools_session_try_receive(FFToolsSession* session);
+/**
+ * Same as fftools_session_try_receive(), but wait up to timeout_ms for a
+ * message if none is queued.
+ */
+int fftools_session_receive_timeout(FFToolsSession* session, int timeout_ms);
+/**
+ * Ask the execution to stop as soon as possible. Blocking reads and writes,
+ * including opening inputs and probing them, are aborted, so outputs may be
+ * left unfinished. May be called from any thread until the session is freed.
+ */
+void fftools_session_cancel(FFToolsSession* session);
+/**
+ * Deliver messages until the execution finishes, then drop the reference
+ * returned on submission, freeing the session unless other references are
+ * held.
+ *
+ * @return the return code of the execution
+ */
+int fftools_session_join(FFToolsSession* session);
+/**
+ * Keep the session allocated past fftools_session_join(), so that other
+ * threads can still call fftools_session_cancel() on it. Every reference
+ * must be dropped with fftools_session_unref().
+ */
+void fftools_session_ref(FFToolsSession* session);
+void fftools_session_unref(FFToolsSession* session);
+
 int ffmpeg_execute_with_callbacks(int argc, char **argv, session_callback_fp session_callback, log_callback_fp log_callback, statistics_callback_fp statistics_callback, void* user_data);
 int ffprobe_execute_with_callbacks(int argc, char **argv, session_callback_fp session_callback, log_callback_fp log_callback, void* user_data);
 
+/**
+ * Sets how many worker threads are kept alive between executions. Executions
+ * beyond this number still run concurrently, on threads that exit afterwards.
+ */
+void fftools_set_max_idle_threads(unsigned int max_idle);
+
+/**
+ * Sets how many codec and filter threads the running executions share, 0 for
+ * the number of cores, the default. Contexts given no thread count, such as
+ * with ffmpeg's -threads, get an equal share of the budget when opened.
+ */
+void fftools_set_thread_budget(unsigned int nb_threads);
+
 #if defined(__cplusplus)
 }  // extern "C"
 #endif
@@ -0,0 +1,263 @@
+#include <stdint.h>
+
+#include "libavutil/error.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "job_scheduler.h"
+
+typedef struct Job {
+    struct Job   *next;
+    JobScheduler *js;
+
+    int64_t key;
+    void  (*func)(void *arg);
+    void  (*cancel)(void *arg, int err);
+    void   *arg;
+
+    int64_t queued_at;
+} Job;
+
+struct JobScheduler {
+    ThreadPool *tp;
+
+    unsigned int max_running;
+    unsigned int nb_running;
+
+    /* FIFO queue per priority class */
+    Job         *head[JS_NB_PRIORITIES];
+    Job         *tail[JS_NB_PRIORITIES];
+    unsigned int nb_queued[JS_NB_PRIORITIES];
+
+    uint64_t nb_started;
+    int64_t  total_wait;
+    int64_t  max_wait;
+
+    pthread_mutex_t lock;
+    /* signalled whenever a running job returns */
+    pthread_cond_t  cond;
+};
+
+/* must be called with the lock held; unlinks and accounts for the jobs that
+ * may start now, returning them as a list to be started without the lock */
+static Job *take_startable_locked(JobScheduler *js)
+{
+    Job *first = NULL, **last = &first;
+    int64_t now = 0;
+
+    while (!js->max_running || js->nb_running < js->max_running) {
+        Job *job = NULL;
+
+        for (int i = 0; i < JS_NB_PRIORITIES && !job; i++) {
+            job = js->head[i];
+            if (job) {
+                js->head[i] = job->next;
+                if (!js->head[i])
+                    js->tail[i] = NULL;
+                js->nb_queued[i]--;
+            }
+        }
+        if (!job)
+            break;
+
+        if (!now)
+            now = av_gettime_relative();
+        js->nb_running++;
+        js->nb_started++;
+        js->total_wait += now - job->queued_at;
+        js->max_wait    = FFMAX(js->max_wait, now - job->queued_at);
+
+        job->next = NULL;
+        *last     = job;
+        last      = &job->next;
+    }
+
+    return first;
+}
+
+static void start_jobs(JobScheduler *js, Job *jobs);
+
+static void run_job(void *arg)
+{
+    Job          *job = arg;
+    JobScheduler *js  = job->js;
+    Job *next;
+
+    job->func(job->arg);
+    av_free(job);
+
+    pthread_mutex_lock(&js->lock);
+    js->nb_running--;
+    next = take_startable_locked(js);
+    pthread_cond_broadcast(&js->cond);
+    pthread_mutex_unlock(&js->lock);
+
+    start_jobs(js, next);
+}
+
+static void start_jobs(JobScheduler *js, Job *jobs)
+{
+    while (jobs) {
+        Job *job = jobs;
+        int ret;
+
+        jobs = job->next;
+
+        ret = tp_submit(js->tp, run_job, job);
+        if (ret < 0) {
+            job->cancel(job->arg, ret);
+            av_free(job);
+
+            pthread_mutex_lock(&js->lock);
+            js->nb_running--;
+            pthread_cond_broadcast(&js->cond);
+            pthread_mutex_unlock(&js->lock);
+        }
+    }
+}
+
+JobScheduler *js_alloc(ThreadPool *tp, unsigned int max_running)
+{
+    JobScheduler *js = av_mallocz(sizeof(*js));
+
+    if (!js)
+        return NULL;
+
+    if (pthread_mutex_init(&js->lock, NULL)) {
+        av_freep(&js);
+        return NULL;
+    }
+    if (pthread_cond_init(&js->cond, NULL)) {
+        pthread_mutex_destroy(&js->lock);
+        av_freep(&js);
+        return NULL;
+    }
+
+    js->tp          = tp;
+    js->max_running = max_running;
+
+    return js;
+}
+
+void js_free(JobScheduler **pjs)
+{
+    JobScheduler *js = *pjs;
+
+    if (!js)
+        return;
+
+    pthread_mutex_lock(&js->lock);
+    for (int i = 0; i < JS_NB_PRIORITIES; i++) {
+        while (js->head[i]) {
+            Job *job = js->head[i];
+            js->head[i] = job->next;
+
+            pthread_mutex_unlock(&js->lock);
+            job->cancel(job->arg, AVERROR_EXIT);
+            av_free(job);
+            pthread_mutex_lock(&js->lock);
+        }
+        js->tail[i]      = NULL;
+        js->nb_queued[i] = 0;
+    }
+    while (js->nb_running)
+        pthread_cond_wait(&js->cond, &js->lock);
+    pthread_mutex_unlock(&js->lock);
+
+    pthread_cond_destroy(&js->cond);
+    pthread_mutex_destroy(&js->lock);
+    av_freep(pjs);
+}
+
+void js_set_max_running(JobScheduler *js, unsigned int max_running)
+{
+    Job *jobs;
+
+    pthread_mutex_lock(&js->lock);
+    js->max_running = max_running;
+    jobs = take_startable_locked(js);
+    pthread_mutex_unlock(&js->lock);
+
+    start_jobs(js, jobs);
+}
+
+int js_submit(JobScheduler *js, enum JobPriority priority, int64_t key,
+              void (*func)(void *arg), void (*cancel)(void *arg, int err),
+              void *arg)
+{
+    Job *job, *jobs;
+
+    if (priority < 0 || priority >= JS_NB_PRIORITIES)
+        return AVERROR(EINVAL);
+
+    job = av_mallocz(sizeof(*job));
+    if (!job)
+        return AVERROR(ENOMEM);
+
+    job->js        = js;
+    job->key       = key;
+    job->func      = func;
+    job->cancel    = cancel;
+    job->arg       = arg;
+    job->queued_at = av_gettime_relative();
+
+    pthread_mutex_lock(&js->lock);
+    if (js->tail[priority])
+        js->tail[priority]->next = job;
+    else
+        js->head[priority] = job;
+    js->tail[priority] = job;
+    js->nb_queued[priority]++;
+    jobs = take_startable_locked(js);
+    pthread_mutex_unlock(&js->lock);
+
+    start_jobs(js, jobs);
+
+    return 0;
+}
+
+int js_cancel(JobScheduler *js, int64_t key)
+{
+    Job *job = NULL;
+
+    pthread_mutex_lock(&js->lock);
+    for (int i = 0; i < JS_NB_PRIORITIES && !job; i++) {
+        Job *prev = NULL;
+
+        for (job = js->head[i]; job; prev = job, job = job->next) {
+            if (job->key != key)
+                continue;
+
+            if (prev)
+                prev->next = job->next;
+            else
+                js->head[i] = job->next;
+            if (js->tail[i] == job)
+                js->tail[i] = prev;
+            js->nb_queued[i]--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&js->lock);
+
+    if (!job)
+        return 0;
+
+    job->cancel(job->arg, AVERROR_EXIT);
+    av_free(job);
+    return 1;
+}
+
+void js_get_stats(JobScheduler *js, JobSchedulerStats *stats)
+{
+    pthread_mutex_lock(&js->lock);
+    stats->nb_running = js->nb_running;
+    for (int i = 0; i < JS_NB_PRIORITIES; i++)
+        stats->nb_queued[i] = js->nb_queued[i];
+    stats->nb_started = js->nb_started;
+    stats->total_wait = js->total_wait;
+    stats->max_wait   = js->max_wait;
+    pthread_mutex_unlock(&js->lock);
+}
@@ -0,0 +1,70 @@
+#ifndef FFTOOLS_JOB_SCHEDULER_H
+#define FFTOOLS_JOB_SCHEDULER_H
+
+#include <stdint.h>
+
+#include "thread_pool.h"
+
+/**
+ * Queue of jobs run on a thread pool with a bounded number of them running at
+ * once.
+ *
+ * Jobs wait in one FIFO queue per priority class. Whenever a job finishes,
+ * the oldest job of the most urgent non-empty class starts. Queued jobs can
+ * be cancelled by the key they were submitted with.
+ */
+typedef struct JobScheduler JobScheduler;
+
+enum JobPriority {
+    JS_PRIORITY_INTERACTIVE = 0,
+    JS_PRIORITY_BACKGROUND,
+    JS_NB_PRIORITIES
+};
+
+typedef struct JobSchedulerStats {
+    unsigned int nb_running;
+    unsigned int nb_queued[JS_NB_PRIORITIES];
+    /** jobs started so far */
+    uint64_t     nb_started;
+    /** time the started jobs spent queued, in microseconds */
+    int64_t      total_wait;
+    int64_t      max_wait;
+} JobSchedulerStats;
+
+/**
+ * @param max_running number of jobs running at once, 0 for no limit
+ */
+JobScheduler *js_alloc(ThreadPool *tp, unsigned int max_running);
+/**
+ * Cancel the queued jobs, wait for the running ones to return and free the
+ * scheduler.
+ */
+void          js_free(JobScheduler **js);
+
+void js_set_max_running(JobScheduler *js, unsigned int max_running);
+
+/**
+ * Run func(arg) once its turn comes.
+ *
+ * @param key identifies the job for js_cancel()
+ * @param cancel called instead of func with a negative AVERROR code if the
+ *               job is cancelled while queued, AVERROR_EXIT, or cannot be
+ *               started
+ * @return 0 on success, a negative AVERROR code if the job could not be
+ *         queued, in which case neither func nor cancel is called
+ */
+int js_submit(JobScheduler *js, enum JobPriority priority, int64_t key,
+              void (*func)(void *arg), void (*cancel)(void *arg, int err),
+              void *arg);
+
+/**
+ * Remove the queued job submitted with key, calling its cancel callback.
+ *
+ * @return 1 if a job was removed, 0 if none with this key is queued, e.g.
+ *         because it was started already
+ */
+int js_cancel(JobScheduler *js, int64_t key);
+
+void js_get_stats(JobScheduler *js, JobSchedulerStats *stats);
+
+#endif // FFTOOLS_JOB_SCHEDULER_H
@@ -0,0 +1,231 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "log_arena.h"
+
+struct LogArenaChunk {
+    LogArena *la;
+    /* links every chunk of the arena, for la_free() */
+    LogArenaChunk *next_all;
+    /* links chunks ready for reuse */
+    LogArenaChunk *next_free;
+
+    /* records not yet released, plus one while a writer is filling the chunk */
+    atomic_uint refs;
+    /* chunks sized for a single long record are freed instead of reused */
+    int oversize;
+
+    size_t size;
+    size_t used;
+    char  *data;
+};
+
+struct LogArena {
+    /* distinguishes arenas that end up at the same address, see cur_chunk */
+    uint64_t id;
+    size_t   chunk_size;
+
+    pthread_mutex_t lock;
+    LogArenaChunk  *all;
+    LogArenaChunk  *free;
+
+    /* links the arenas not yet freed */
+    LogArena *next;
+};
+
+static atomic_uint_fast64_t next_arena_id = 1;
+
+/* the arenas not yet freed, so that a thread moving on to another arena can
+ * tell whether the chunk it was filling may still be released */
+static AVOnce          arenas_once = AV_ONCE_INIT;
+static pthread_mutex_t arenas_lock;
+static LogArena       *arenas;
+
+static void arenas_lock_init(void)
+{
+    pthread_mutex_init(&arenas_lock, NULL);
+}
+
+/* the chunk this thread is currently filling, and the arena it belongs to;
+ * the chunk is only dereferenced while cur_arena_id matches */
+static __thread uint64_t       cur_arena_id;
+static __thread LogArenaChunk *cur_chunk;
+
+LogArena *la_alloc(size_t chunk_size)
+{
+    LogArena *la = av_mallocz(sizeof(*la));
+
+    if (!la)
+        return NULL;
+
+    if (pthread_mutex_init(&la->lock, NULL)) {
+        av_freep(&la);
+        return NULL;
+    }
+
+    la->id         = atomic_fetch_add(&next_arena_id, 1);
+    la->chunk_size = chunk_size;
+
+    ff_thread_once(&arenas_once, arenas_lock_init);
+    pthread_mutex_lock(&arenas_lock);
+    la->next = arenas;
+    arenas   = la;
+    pthread_mutex_unlock(&arenas_lock);
+
+    return la;
+}
+
+void la_free(LogArena **pla)
+{
+    LogArena *la = *pla;
+    LogArena **p = &arenas;
+    LogArenaChunk *c;
+
+    if (!la)
+        return;
+
+    pthread_mutex_lock(&arenas_lock);
+    while (*p != la)
+        p = &(*p)->next;
+    *p = la->next;
+    pthread_mutex_unlock(&arenas_lock);
+
+    c = la->all;
+    while (c) {
+        LogArenaChunk *next = c->next_all;
+        av_free(c);
+        c = next;
+    }
+
+    pthread_mutex_destroy(&la->lock);
+    av_freep(pla);
+}
+
+/* the chunk struct and its data share one allocation */
+static LogArenaChunk *chunk_alloc(LogArena *la, size_t size)
+{
+    LogArenaChunk *c = av_malloc(sizeof(*c) + size);
+
+    if (!c)
+        return NULL;
+
+    c->la        = la;
+    c->next_free = NULL;
+    c->oversize  = size != la->chunk_size;
+    c->size      = size;
+    c->used      = 0;
+    c->data      = (char*)(c + 1);
+
+    pthread_mutex_lock(&la->lock);
+    c->next_all = la->all;
+    la->all     = c;
+    pthread_mutex_unlock(&la->lock);
+
+    return c;
+}
+
+static LogArenaChunk *chunk_get(LogArena *la)
+{
+    LogArenaChunk *c;
+
+    pthread_mutex_lock(&la->lock);
+    c = la->free;
+    if (c)
+        la->free = c->next_free;
+    pthread_mutex_unlock(&la->lock);
+
+    if (!c)
+        c = chunk_alloc(la, la->chunk_size);
+    if (c) {
+        c->used = 0;
+        atomic_init(&c->refs, 1);
+    }
+
+    return c;
+}
+
+/* called by whoever dropped the last reference */
+static void chunk_recycle(LogArenaChunk *c)
+{
+    LogArena *la = c->la;
+
+    pthread_mutex_lock(&la->lock);
+    if (c->oversize) {
+        LogArenaChunk **p = &la->all;
+        while (*p != c)
+            p = &(*p)->next_all;
+        *p = c->next_all;
+        av_free(c);
+    } else {
+        c->next_free = la->free;
+        la->free     = c;
+    }
+    pthread_mutex_unlock(&la->lock);
+}
+
+void la_release(LogArenaChunk *c, unsigned int nb_records)
+{
+    if (!c || !nb_records)
+        return;
+
+    if (atomic_fetch_sub_explicit(&c->refs, nb_records, memory_order_acq_rel) == nb_records)
+        chunk_recycle(c);
+}
+
+/* drop the writer reference of the chunk this thread was filling in another
+ * arena, unless that arena was freed in the meantime */
+static void release_cur_chunk(void)
+{
+    LogArena *la;
+
+    pthread_mutex_lock(&arenas_lock);
+    for (la = arenas; la; la = la->next) {
+        if (la->id == cur_arena_id) {
+            la_release(cur_chunk, 1);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&arenas_lock);
+}
+
+char *la_strndup(LogArena *la, const char *text, size_t len, LogArenaChunk **chunk)
+{
+    LogArenaChunk *c;
+    char *dst;
+
+    if (len + 1 > la->chunk_size) {
+        c = chunk_alloc(la, len + 1);
+        if (!c)
+            return NULL;
+        atomic_init(&c->refs, 1);
+    } else {
+        if (cur_arena_id != la->id || cur_chunk->used + len + 1 > cur_chunk->size) {
+            /* done filling the previous chunk, drop the writer reference */
+            if (cur_arena_id == la->id)
+                la_release(cur_chunk, 1);
+            else if (cur_arena_id)
+                release_cur_chunk();
+
+            cur_arena_id = 0;
+            cur_chunk    = chunk_get(la);
+            if (!cur_chunk)
+                return NULL;
+            cur_arena_id = la->id;
+        }
+        c = cur_chunk;
+        atomic_fetch_add_explicit(&c->refs, 1, memory_order_relaxed);
+    }
+
+    dst = c->data + c->used;
+    memcpy(dst, text, len);
+    dst[len] = 0;
+    c->used += len + 1;
+
+    *chunk = c;
+    return dst;
+}
@@ -0,0 +1,43 @@
+#ifndef FFTOOLS_LOG_ARENA_H
+#define FFTOOLS_LOG_ARENA_H
+
+#include <stddef.h>
+
+/**
+ * Chunked storage for log text written by any number of threads and released
+ * in bulk by whoever consumes it.
+ *
+ * Each writing thread fills a chunk of its own, so copying text in takes no
+ * lock. A chunk counts the records still referencing it and goes back to the
+ * arena for reuse once the writer has moved on and every record was
+ * released, so a steady stream of log lines allocates nothing.
+ */
+typedef struct LogArena LogArena;
+typedef struct LogArenaChunk LogArenaChunk;
+
+/**
+ * @param chunk_size size of one chunk in bytes; longer text gets a chunk of
+ *                   its own
+ */
+LogArena *la_alloc(size_t chunk_size);
+/**
+ * Free the arena and all its chunks. No text from it may be used afterwards,
+ * released or not.
+ */
+void      la_free(LogArena **la);
+
+/**
+ * Copy len bytes of text, followed by a terminating NUL, into the arena.
+ *
+ * @param chunk the chunk holding the copy is written here; pass it to
+ *              la_release() once the copy is no longer needed
+ * @return the copy, or NULL on allocation failure
+ */
+char *la_strndup(LogArena *la, const char *text, size_t len, LogArenaChunk **chunk);
+
+/**
+ * Release nb_records copies previously returned by la_strndup() for chunk.
+ */
+void  la_release(LogArenaChunk *chunk, unsigned int nb_records);
+
+#endif // FFTOOLS_LOG_ARENA_H
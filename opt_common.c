@@ -75,6 +75,8 @@ enum show_muxdemuxers {
 
 int init_report(const char *env, FILE **file);
 extern void fftools_log_callback_function(void *ptr, int level, const char* format, va_list vargs);
+extern int fftools_get_log_level(void);
+extern void fftools_set_log_level(int level);
 extern void (*report_callback)(int, float, float, int64_t, int, double, double);
 void log_callback_report(void *ptr, int level, const char *fmt, va_list vl);
 
@@ -1191,7 +1193,7 @@ int init_report(const char *env, FILE **file)
         return AVERROR(ENOMEM);
     }
 
-    prog_loglevel = av_log_get_level();
+    prog_loglevel = fftools_get_log_level();
     if (!envlevel)
         report_file_level = FFMAX(report_file_level, prog_loglevel);
 
@@ -1254,7 +1256,7 @@ int opt_loglevel(void *optctx, const char *opt, const char *arg)
     const char *token;
     char *tail;
     int flags = av_log_get_flags();
-    int level = av_log_get_level();
+    int level = fftools_get_log_level();
     int cmd, i = 0;
 
     av_assert0(arg);
@@ -1311,7 +1313,7 @@ int opt_loglevel(void *optctx, const char *opt, const char *arg)
 
 end:
     av_log_set_flags(flags);
-    av_log_set_level(level);
+    fftools_set_log_level(level);
     return 0;
 }
 
@@ -1407,9 +1409,9 @@ int show_sources(void *optctx, const char *opt, const char *arg)
     char *dev = NULL;
     AVDictionary *opts = NULL;
     int ret = 0;
-    int error_level = av_log_get_level();
+    int error_level = fftools_get_log_level();
 
-    av_log_set_level(AV_LOG_WARNING);
+    fftools_set_log_level(AV_LOG_WARNING);
 
     if ((ret = show_sinks_sources_parse_arg(arg, &dev, &opts)) < 0)
         goto fail;
@@ -1435,7 +1437,7 @@ int show_sources(void *optctx, const char *opt, const char *arg)
   fail:
     av_dict_free(&opts);
     av_free(dev);
-    av_log_set_level(error_level);
+    fftools_set_log_level(error_level);
     return ret;
 }
 
@@ -1445,9 +1447,9 @@ int show_sinks(void *optctx, const char *opt, const char *arg)
     char *dev = NULL;
     AVDictionary *opts = NULL;
     int ret = 0;
-    int error_level = av_log_get_level();
+    int error_level = fftools_get_log_level();
 
-    av_log_set_level(AV_LOG_WARNING);
+    fftools_set_log_level(AV_LOG_WARNING);
 
     if ((ret = show_sinks_sources_parse_arg(arg, &dev, &opts)) < 0)
         goto fail;
@@ -1471,7 +1473,7 @@ int show_sinks(void *optctx, const char *opt, const char *arg)
   fail:
     av_dict_free(&opts);
     av_free(dev);
-    av_log_set_level(error_level);
+    fftools_set_log_level(error_level);
     return ret;
 }
 #endif /* CONFIG_AVDEVICE */
@@ -0,0 +1,178 @@
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+
+#include "ptr_map.h"
+
+/* key values that are never valid pointers */
+#define KEY_EMPTY     ((uintptr_t)0)
+#define KEY_TOMBSTONE ((uintptr_t)1)
+
+typedef struct PtrMapEntry {
+    /* KEY_EMPTY until first used; KEY_TOMBSTONE after removal, so lookups
+     * keep probing past it */
+    atomic_uintptr_t key;
+    /* NULL while the entry is being set or removed */
+    _Atomic(void *)  value;
+} PtrMapEntry;
+
+struct PtrMap {
+    PtrMapEntry *entries;
+    size_t       mask;
+    /* largest distance of a key from its hash slot so far; removed entries
+     * are never emptied, so lookups stop after this many instead */
+    atomic_size_t max_probe;
+};
+
+PtrMap *pm_alloc(size_t capacity)
+{
+    PtrMap *pm;
+    size_t nb_entries = 2;
+
+    while (nb_entries < capacity)
+        nb_entries <<= 1;
+
+    pm = av_mallocz(sizeof(*pm));
+    if (!pm)
+        return NULL;
+
+    pm->entries = av_calloc(nb_entries, sizeof(*pm->entries));
+    if (!pm->entries) {
+        av_freep(&pm);
+        return NULL;
+    }
+    pm->mask = nb_entries - 1;
+    atomic_init(&pm->max_probe, 0);
+
+    for (size_t i = 0; i < nb_entries; i++) {
+        atomic_init(&pm->entries[i].key, KEY_EMPTY);
+        atomic_init(&pm->entries[i].value, NULL);
+    }
+
+    return pm;
+}
+
+void pm_free(PtrMap **ppm)
+{
+    PtrMap *pm = *ppm;
+
+    if (!pm)
+        return;
+
+    av_freep(&pm->entries);
+    av_freep(ppm);
+}
+
+static size_t hash_key(uintptr_t key)
+{
+    /* allocations are aligned, so mix the high bits down */
+    uint64_t h = (uint64_t)key * UINT64_C(0x9E3779B97F4A7C15);
+    return (size_t)(h >> 32);
+}
+
+static PtrMapEntry *find(PtrMap *pm, uintptr_t key)
+{
+    size_t h     = hash_key(key);
+    size_t probe = atomic_load_explicit(&pm->max_probe, memory_order_acquire);
+
+    for (size_t i = 0; i <= probe; i++) {
+        PtrMapEntry *e = &pm->entries[(h + i) & pm->mask];
+        uintptr_t    k = atomic_load_explicit(&e->key, memory_order_acquire);
+
+        if (k == key)
+            return e;
+        if (k == KEY_EMPTY)
+            break;
+    }
+
+    return NULL;
+}
+
+static void update_max_probe(PtrMap *pm, size_t probe)
+{
+    size_t cur = atomic_load_explicit(&pm->max_probe, memory_order_relaxed);
+
+    while (cur < probe &&
+           !atomic_compare_exchange_weak_explicit(&pm->max_probe, &cur, probe,
+                                                  memory_order_release,
+                                                  memory_order_relaxed));
+}
+
+int pm_set(PtrMap *pm, const void *pkey, void *value)
+{
+    uintptr_t key = (uintptr_t)pkey;
+    PtrMapEntry *e = find(pm, key);
+    size_t h;
+
+    if (e) {
+        atomic_store_explicit(&e->value, value, memory_order_release);
+        return 0;
+    }
+
+    h = hash_key(key);
+    for (size_t i = 0; i <= pm->mask; i++) {
+        uintptr_t k;
+
+        e = &pm->entries[(h + i) & pm->mask];
+        k = atomic_load_explicit(&e->key, memory_order_relaxed);
+
+        while (k == KEY_EMPTY || k == KEY_TOMBSTONE) {
+            /* raised first, so that lookups reach the key once it is set */
+            update_max_probe(pm, i);
+            if (atomic_compare_exchange_weak_explicit(&e->key, &k, key,
+                                                      memory_order_acq_rel,
+                                                      memory_order_relaxed)) {
+                atomic_store_explicit(&e->value, value, memory_order_release);
+                return 0;
+            }
+        }
+    }
+
+    return AVERROR(ENOSPC);
+}
+
+void *pm_get(PtrMap *pm, const void *pkey)
+{
+    uintptr_t key = (uintptr_t)pkey;
+    PtrMapEntry *e = find(pm, key);
+    void *value;
+
+    if (!e)
+        return NULL;
+
+    value = atomic_load_explicit(&e->value, memory_order_acquire);
+    /* the entry may have been removed and reused meanwhile */
+    if (atomic_load_explicit(&e->key, memory_order_acquire) != key)
+        return NULL;
+
+    return value;
+}
+
+void pm_remove(PtrMap *pm, const void *pkey)
+{
+    PtrMapEntry *e = find(pm, (uintptr_t)pkey);
+
+    if (!e)
+        return;
+
+    atomic_store_explicit(&e->value, NULL, memory_order_relaxed);
+    atomic_store_explicit(&e->key, KEY_TOMBSTONE, memory_order_release);
+}
+
+void pm_remove_value(PtrMap *pm, const void *value)
+{
+    if (!value)
+        return;
+
+    for (size_t i = 0; i <= pm->mask; i++) {
+        PtrMapEntry *e = &pm->entries[i];
+
+        if (atomic_load_explicit(&e->value, memory_order_relaxed) != value)
+            continue;
+
+        atomic_store_explicit(&e->value, NULL, memory_order_relaxed);
+        atomic_store_explicit(&e->key, KEY_TOMBSTONE, memory_order_release);
+    }
+}
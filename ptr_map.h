@@ -0,0 +1,43 @@
+#ifndef FFTOOLS_PTR_MAP_H
+#define FFTOOLS_PTR_MAP_H
+
+#include <stddef.h>
+
+/**
+ * Fixed-capacity map from pointers to pointers.
+ *
+ * Lookups take no lock and never wait, which makes the map usable from log
+ * callbacks on any thread. Entries live in an open-addressing table that is
+ * never resized; once it is full, further keys are refused.
+ *
+ * Any number of threads may look up, set and remove concurrently, as long as
+ * no two threads set the same key at the same time.
+ */
+typedef struct PtrMap PtrMap;
+
+/**
+ * @param capacity number of entries, rounded up to a power of two
+ */
+PtrMap *pm_alloc(size_t capacity);
+void    pm_free(PtrMap **pm);
+
+/**
+ * Map key to value, replacing any value key was mapped to.
+ *
+ * @return 0 on success, AVERROR(ENOSPC) if the map is full
+ */
+int   pm_set(PtrMap *pm, const void *key, void *value);
+/**
+ * @return the value key is mapped to, or NULL if there is none
+ */
+void *pm_get(PtrMap *pm, const void *key);
+/**
+ * Remove the entry of key, if any.
+ */
+void  pm_remove(PtrMap *pm, const void *key);
+/**
+ * Remove every entry mapped to value.
+ */
+void  pm_remove_value(PtrMap *pm, const void *value);
+
+#endif // FFTOOLS_PTR_MAP_H
@@ -0,0 +1,419 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#if HAVE_POLL_H
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "read_ahead.h"
+
+/* most bytes the I/O thread asks for at once */
+#define RA_BLOCK_SIZE     (256 * 1024)
+/* size of the buffer of the AVIOContext handed to the reader */
+#define RA_IO_BUFFER_SIZE (32 * 1024)
+/* how often a waiting reader checks the interrupt callback, in microseconds */
+#define RA_INTERRUPT_POLL 100000
+
+#if HAVE_POLL_H
+
+struct ReadAhead {
+    /* input, non-blocking so that waiting for data can be interrupted */
+    int             fd;
+    /* status flags of fd to restore when it is not ours to close, -1 if it is */
+    int             fd_flags;
+    /* written to by ra_close() to wake the I/O thread waiting for data */
+    int             wake[2];
+    AVIOContext    *pb;
+    AVIOInterruptCB int_cb;
+    int64_t         size;
+    int             seekable;
+
+    uint8_t *buf;
+    size_t   buf_size;
+
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    /* signalled when data arrives or reading failed */
+    pthread_cond_t  data_cond;
+    /* signalled when room is made, a seek is requested or on closing */
+    pthread_cond_t  space_cond;
+
+    /* bumped by every seek dropping the window; a read started before
+     * completes into nothing */
+    unsigned int generation;
+    int          seek_pending;
+    /* also read without the lock, by the I/O thread waiting for data */
+    atomic_int   stop;
+
+    /* position in the input of the start of the window */
+    int64_t  pos;
+    /* bytes read into and consumed from the window since it started, the
+     * ring buffer holding the difference at offsets modulo buf_size */
+    uint64_t filled;
+    uint64_t consumed;
+    /* error or AVERROR_EOF ending the window, 0 if none */
+    int      err;
+};
+
+static int check_interrupt(ReadAhead *ra)
+{
+    return ra->int_cb.callback && ra->int_cb.callback(ra->int_cb.opaque);
+}
+
+/* read up to len bytes of the input straight into buf, waiting for data
+ * until there is some, the input ends, ra_close() is called or the interrupt
+ * callback fires */
+static int src_read(ReadAhead *ra, uint8_t *buf, size_t len)
+{
+    while (1) {
+        struct pollfd pfd[2] = {
+            { .fd = ra->fd,      .events = POLLIN },
+            { .fd = ra->wake[0], .events = POLLIN },
+        };
+        ssize_t ret = read(ra->fd, buf, len);
+
+        if (ret > 0)
+            return ret;
+        if (!ret)
+            return AVERROR_EOF;
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            return AVERROR(errno);
+
+        if (atomic_load(&ra->stop) || check_interrupt(ra))
+            return AVERROR_EXIT;
+        /* the timeout only serves the interrupt callback, closing wakes
+         * the wait through the wake pipe */
+        if (poll(pfd, 2, RA_INTERRUPT_POLL / 1000) < 0 && errno != EINTR)
+            return AVERROR(errno);
+    }
+}
+
+static void *io_thread(void *arg)
+{
+    ReadAhead *ra = arg;
+
+    pthread_mutex_lock(&ra->lock);
+    while (1) {
+        unsigned int generation;
+        size_t idx, len;
+        int ret;
+
+        while (!atomic_load(&ra->stop) && !ra->seek_pending &&
+               (ra->err || ra->filled - ra->consumed == ra->buf_size))
+            pthread_cond_wait(&ra->space_cond, &ra->lock);
+        if (atomic_load(&ra->stop))
+            break;
+
+        generation = ra->generation;
+
+        if (ra->seek_pending) {
+            int64_t pos = ra->pos;
+
+            ra->seek_pending = 0;
+            pthread_mutex_unlock(&ra->lock);
+            pos = lseek(ra->fd, pos, SEEK_SET);
+            if (pos < 0)
+                pos = AVERROR(errno);
+            pthread_mutex_lock(&ra->lock);
+
+            if (pos < 0 && generation == ra->generation) {
+                ra->err = pos;
+                pthread_cond_signal(&ra->data_cond);
+            }
+            continue;
+        }
+
+        /* the reader only touches the filled part, so the free part can be
+         * written to without the lock */
+        idx = ra->filled % ra->buf_size;
+        len = FFMIN(ra->buf_size - idx, ra->buf_size - (ra->filled - ra->consumed));
+        len = FFMIN(len, RA_BLOCK_SIZE);
+
+        pthread_mutex_unlock(&ra->lock);
+        ret = src_read(ra, ra->buf + idx, len);
+        pthread_mutex_lock(&ra->lock);
+
+        if (generation != ra->generation)
+            continue;
+        if (ret > 0)
+            ra->filled += ret;
+        else
+            ra->err = ret;
+        pthread_cond_signal(&ra->data_cond);
+    }
+    pthread_mutex_unlock(&ra->lock);
+
+    return NULL;
+}
+
+static int read_packet(void *opaque, uint8_t *buf, int buf_size)
+{
+    ReadAhead *ra = opaque;
+    size_t idx, len;
+
+    pthread_mutex_lock(&ra->lock);
+    while (ra->filled == ra->consumed && !ra->err) {
+        struct timespec abstime;
+        int64_t t;
+
+        if (check_interrupt(ra)) {
+            pthread_mutex_unlock(&ra->lock);
+            return AVERROR_EXIT;
+        }
+
+        /* pthread_cond_timedwait() takes a wall-clock deadline */
+        t = av_gettime() + RA_INTERRUPT_POLL;
+        abstime.tv_sec  = t / 1000000;
+        abstime.tv_nsec = (t % 1000000) * 1000;
+        pthread_cond_timedwait(&ra->data_cond, &ra->lock, &abstime);
+    }
+    if (ra->filled == ra->consumed) {
+        int err = ra->err;
+        pthread_mutex_unlock(&ra->lock);
+        return err;
+    }
+
+    idx = ra->consumed % ra->buf_size;
+    len = FFMIN(ra->filled - ra->consumed, ra->buf_size - idx);
+    len = FFMIN(len, (size_t)buf_size);
+    pthread_mutex_unlock(&ra->lock);
+
+    /* the I/O thread does not write to the filled part, and only this thread
+     * moves the window */
+    memcpy(buf, ra->buf + idx, len);
+
+    pthread_mutex_lock(&ra->lock);
+    ra->consumed += len;
+    pthread_cond_signal(&ra->space_cond);
+    pthread_mutex_unlock(&ra->lock);
+
+    return len;
+}
+
+static int64_t seek(void *opaque, int64_t offset, int whence)
+{
+    ReadAhead *ra = opaque;
+    int64_t cur;
+
+    if (whence == AVSEEK_SIZE)
+        return ra->size;
+
+    pthread_mutex_lock(&ra->lock);
+    cur = ra->pos + ra->consumed;
+    switch (whence) {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += cur;
+        break;
+    case SEEK_END:
+        if (ra->size < 0) {
+            pthread_mutex_unlock(&ra->lock);
+            return AVERROR(ENOSYS);
+        }
+        offset += ra->size;
+        break;
+    default:
+        pthread_mutex_unlock(&ra->lock);
+        return AVERROR(EINVAL);
+    }
+
+    if (offset >= cur && offset <= ra->pos + (int64_t)ra->filled) {
+        /* within the window, skip to it */
+        ra->consumed += offset - cur;
+    } else {
+        ra->generation++;
+        ra->seek_pending = 1;
+        ra->pos          = offset;
+        ra->filled       = 0;
+        ra->consumed     = 0;
+        ra->err          = 0;
+    }
+    pthread_cond_signal(&ra->space_cond);
+    pthread_mutex_unlock(&ra->lock);
+
+    return offset;
+}
+
+/* open the input, a duplicate of fd if it is not negative, url otherwise */
+static int src_open(ReadAhead *ra, const char *url, int fd)
+{
+    struct stat st;
+    int flags, ret;
+
+    ra->fd_flags = -1;
+    if (fd >= 0) {
+        ra->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    } else {
+        av_strstart(url, "file:", &url);
+        ra->fd = open(url, O_RDONLY | O_CLOEXEC);
+    }
+    if (ra->fd < 0)
+        return AVERROR(errno);
+
+    /* status flags belong to the open file, which a duplicate shares with
+     * the caller */
+    flags = fcntl(ra->fd, F_GETFL);
+    if (flags < 0 || fcntl(ra->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        ret = AVERROR(errno);
+        close(ra->fd);
+        return ret;
+    }
+    if (fd >= 0)
+        ra->fd_flags = flags;
+
+    if (!fstat(ra->fd, &st) && S_ISREG(st.st_mode)) {
+        ra->size     = st.st_size;
+        ra->seekable = AVIO_SEEKABLE_NORMAL;
+    } else {
+        ra->size     = -1;
+    }
+    ra->pos = FFMAX(lseek(ra->fd, 0, SEEK_CUR), 0);
+
+    return 0;
+}
+
+static void src_close(ReadAhead *ra)
+{
+    if (ra->fd_flags >= 0)
+        fcntl(ra->fd, F_SETFL, ra->fd_flags);
+    close(ra->fd);
+}
+
+int ra_open(ReadAhead **pra, AVIOContext **pb, const char *url, int fd,
+            size_t window, const AVIOInterruptCB *int_cb, AVDictionary **options)
+{
+    ReadAhead *ra;
+    uint8_t *io_buf;
+    int ret;
+
+    *pra = NULL;
+    *pb  = NULL;
+
+    ra = av_mallocz(sizeof(*ra));
+    if (!ra)
+        return AVERROR(ENOMEM);
+
+    atomic_init(&ra->stop, 0);
+    if (int_cb)
+        ra->int_cb = *int_cb;
+
+    ret = src_open(ra, url, fd);
+    if (ret < 0) {
+        av_freep(&ra);
+        return ret;
+    }
+    /* read by the pipe and fd protocols, which are not used */
+    if (fd >= 0)
+        av_dict_set(options, "fd", NULL, 0);
+
+    if (pipe(ra->wake) < 0) {
+        ret = AVERROR(errno);
+        src_close(ra);
+        av_freep(&ra);
+        return ret;
+    }
+
+    ra->buf_size = FFMAX((window + RA_BLOCK_SIZE - 1) / RA_BLOCK_SIZE, 2) * RA_BLOCK_SIZE;
+    ra->buf      = av_malloc(ra->buf_size);
+    io_buf       = av_malloc(RA_IO_BUFFER_SIZE);
+    if (io_buf)
+        ra->pb = avio_alloc_context(io_buf, RA_IO_BUFFER_SIZE, 0, ra,
+                                    read_packet, NULL, seek);
+    if (!ra->buf || !ra->pb) {
+        if (!ra->pb)
+            av_free(io_buf);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    ra->pb->seekable = ra->seekable;
+
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->data_cond, NULL);
+    pthread_cond_init(&ra->space_cond, NULL);
+
+    ret = pthread_create(&ra->thread, NULL, io_thread, ra);
+    if (ret) {
+        ret = AVERROR(ret);
+        pthread_mutex_destroy(&ra->lock);
+        pthread_cond_destroy(&ra->data_cond);
+        pthread_cond_destroy(&ra->space_cond);
+        goto fail;
+    }
+
+    *pra = ra;
+    *pb  = ra->pb;
+    return 0;
+
+fail:
+    if (ra->pb)
+        av_freep(&ra->pb->buffer);
+    avio_context_free(&ra->pb);
+    av_freep(&ra->buf);
+    close(ra->wake[0]);
+    close(ra->wake[1]);
+    src_close(ra);
+    av_freep(&ra);
+    return ret;
+}
+
+void ra_close(ReadAhead **pra)
+{
+    ReadAhead *ra = *pra;
+
+    if (!ra)
+        return;
+
+    pthread_mutex_lock(&ra->lock);
+    atomic_store(&ra->stop, 1);
+    pthread_cond_signal(&ra->space_cond);
+    pthread_mutex_unlock(&ra->lock);
+    /* the pipe is only written to once, it cannot be full */
+    if (write(ra->wake[1], "", 1) < 0)
+        av_log(NULL, AV_LOG_WARNING, "Could not wake the read-ahead thread\n");
+    pthread_join(ra->thread, NULL);
+
+    pthread_mutex_destroy(&ra->lock);
+    pthread_cond_destroy(&ra->data_cond);
+    pthread_cond_destroy(&ra->space_cond);
+
+    av_freep(&ra->pb->buffer);
+    avio_context_free(&ra->pb);
+    av_freep(&ra->buf);
+    close(ra->wake[0]);
+    close(ra->wake[1]);
+    src_close(ra);
+    av_freep(pra);
+}
+
+#else
+
+int ra_open(ReadAhead **pra, AVIOContext **pb, const char *url, int fd,
+            size_t window, const AVIOInterruptCB *int_cb, AVDictionary **options)
+{
+    *pra = NULL;
+    *pb  = NULL;
+    return AVERROR(ENOSYS);
+}
+
+void ra_close(ReadAhead **pra)
+{
+}
+
+#endif /* HAVE_POLL_H */
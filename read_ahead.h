@@ -0,0 +1,49 @@
+#ifndef FFTOOLS_READ_AHEAD_H
+#define FFTOOLS_READ_AHEAD_H
+
+#include <stddef.h>
+
+#include "libavformat/avio.h"
+#include "libavutil/dict.h"
+
+/**
+ * Reading through a dedicated I/O thread that keeps a window of data ahead of
+ * the reader, so that slow storage stalls the reader only when it catches up.
+ *
+ * The I/O thread reads large blocks of a local file or pipe straight from its
+ * descriptor into a ring buffer. The descriptor is non-blocking, so waiting
+ * for pipe data ends as soon as the input is closed or interrupted. A seek to
+ * data already in the window skips forward to it; any other seek drops the
+ * window and has the I/O thread restart from the new position, without
+ * waiting for a read in progress.
+ *
+ * Only available where poll() is, ra_open() fails with ENOSYS elsewhere.
+ */
+typedef struct ReadAhead ReadAhead;
+
+/**
+ * Open an input for reading and start the I/O thread.
+ *
+ * @param pb      the context to read through is written here; it belongs to
+ *                the ReadAhead and must only be used by one thread
+ * @param url     local file to read, with or without the file: prefix
+ * @param fd      descriptor of a pipe input to read instead of url, -1 for
+ *                none; it is duplicated and left open, but is non-blocking
+ *                until ra_close()
+ * @param window  bytes kept ahead of the reader, rounded up to whole blocks
+ * @param int_cb  interrupts blocking I/O, may be NULL; it is called on the I/O
+ *                thread too, so it must not depend on thread-local state
+ * @param options protocol options; the fd option of pipe inputs is removed
+ *                from it, others are not supported and left in it
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int  ra_open(ReadAhead **ra, AVIOContext **pb, const char *url, int fd,
+             size_t window, const AVIOInterruptCB *int_cb,
+             AVDictionary **options);
+/**
+ * Stop the I/O thread, close the input and free the context returned by
+ * ra_open().
+ */
+void ra_close(ReadAhead **ra);
+
+#endif // FFTOOLS_READ_AHEAD_H
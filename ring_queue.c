@@ -0,0 +1,409 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "libavutil/error.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "ring_queue.h"
+
+enum {
+    FINISHED_SEND = (1 << 0),
+    FINISHED_RECV = (1 << 1),
+};
+
+/* keeps the indices written by senders and receivers on separate cache lines */
+#define CACHE_LINE 64
+
+typedef struct RingSlot {
+    /* == position:                 free, waiting for the sender at position
+     * == position + 1:             holds the item sent at position
+     * == position + nb_slots:      free again, for the next lap */
+    atomic_size_t seq;
+    /* whether the item may not be evicted; atomic as rq_try_evict() reads
+     * it before claiming the slot */
+    atomic_int    pinned;
+    /* elem_size bytes of item data follow */
+} RingSlot;
+
+struct RingQueue {
+    uint8_t *slots;
+    size_t   slot_size;
+    size_t   elem_size;
+    size_t   mask;
+
+    void (*elem_reset)(void *elem);
+    int  (*elem_pinned)(const void *elem);
+
+    char pad0[CACHE_LINE];
+    atomic_size_t tail;
+    char pad1[CACHE_LINE - sizeof(atomic_size_t)];
+    atomic_size_t head;
+    char pad2[CACHE_LINE - sizeof(atomic_size_t)];
+
+    atomic_int finished;
+
+    /* number of threads parked, or about to park, on each condition */
+    atomic_int send_waiters;
+    atomic_int recv_waiters;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  send_cond;
+    pthread_cond_t  recv_cond;
+};
+
+static inline RingSlot *slot_at(const RingQueue *rq, size_t pos)
+{
+    return (RingSlot*)(rq->slots + (pos & rq->mask) * rq->slot_size);
+}
+
+static inline void *slot_data(RingSlot *slot)
+{
+    return (uint8_t*)slot + sizeof(RingSlot);
+}
+
+/* Wake the threads parked on cond, if any. The fence orders the preceding
+ * slot update before the waiter count is read; waiters increment the count
+ * before re-checking the slots, so either they see the update or we see
+ * them. */
+static void wake_waiters(RingQueue *rq, atomic_int *waiters, pthread_cond_t *cond)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(waiters, memory_order_relaxed))
+        return;
+
+    pthread_mutex_lock(&rq->lock);
+    pthread_cond_broadcast(cond);
+    pthread_mutex_unlock(&rq->lock);
+}
+
+void rq_free(RingQueue **prq)
+{
+    RingQueue *rq = *prq;
+
+    if (!rq)
+        return;
+
+    if (rq->slots && rq->elem_reset) {
+        size_t head = atomic_load(&rq->head);
+        size_t tail = atomic_load(&rq->tail);
+        for (size_t pos = head; pos != tail; pos++) {
+            RingSlot *slot = slot_at(rq, pos);
+            if (atomic_load(&slot->seq) == pos + 1)
+                rq->elem_reset(slot_data(slot));
+        }
+    }
+    av_freep(&rq->slots);
+
+    pthread_cond_destroy(&rq->recv_cond);
+    pthread_cond_destroy(&rq->send_cond);
+    pthread_mutex_destroy(&rq->lock);
+
+    av_freep(prq);
+}
+
+RingQueue *rq_alloc(size_t capacity, size_t elem_size,
+                    void (*elem_reset)(void *elem))
+{
+    RingQueue *rq;
+    size_t nb_slots = 2;
+    int ret;
+
+    while (nb_slots < capacity)
+        nb_slots <<= 1;
+
+    rq = av_mallocz(sizeof(*rq));
+    if (!rq)
+        return NULL;
+
+    ret = pthread_mutex_init(&rq->lock, NULL);
+    if (ret) {
+        av_freep(&rq);
+        return NULL;
+    }
+
+    ret = pthread_cond_init(&rq->send_cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&rq->lock);
+        av_freep(&rq);
+        return NULL;
+    }
+
+    ret = pthread_cond_init(&rq->recv_cond, NULL);
+    if (ret) {
+        pthread_cond_destroy(&rq->send_cond);
+        pthread_mutex_destroy(&rq->lock);
+        av_freep(&rq);
+        return NULL;
+    }
+
+    rq->elem_size  = elem_size;
+    rq->slot_size  = FFALIGN(sizeof(RingSlot) + elem_size, 16);
+    rq->mask       = nb_slots - 1;
+    rq->elem_reset = elem_reset;
+
+    rq->slots = av_malloc(nb_slots * rq->slot_size);
+    if (!rq->slots)
+        goto fail;
+
+    for (size_t i = 0; i < nb_slots; i++) {
+        atomic_init(&slot_at(rq, i)->seq, i);
+        atomic_init(&slot_at(rq, i)->pinned, 0);
+    }
+    atomic_init(&rq->head, 0);
+    atomic_init(&rq->tail, 0);
+    atomic_init(&rq->finished, 0);
+    atomic_init(&rq->send_waiters, 0);
+    atomic_init(&rq->recv_waiters, 0);
+
+    return rq;
+fail:
+    rq_free(&rq);
+    return NULL;
+}
+
+size_t rq_capacity(const RingQueue *rq)
+{
+    return rq->mask + 1;
+}
+
+void rq_set_pinned(RingQueue *rq, int (*elem_pinned)(const void *elem))
+{
+    rq->elem_pinned = elem_pinned;
+}
+
+/* claim the slot at the tail and fill it; AVERROR(EAGAIN) if full */
+static int push(RingQueue *rq, const void *data)
+{
+    size_t pos = atomic_load_explicit(&rq->tail, memory_order_relaxed);
+    RingSlot *slot;
+
+    while (1) {
+        size_t   seq;
+        intptr_t dif;
+
+        slot = slot_at(rq, pos);
+        seq  = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        dif  = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&rq->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return AVERROR(EAGAIN);
+        } else {
+            pos = atomic_load_explicit(&rq->tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(slot_data(slot), data, rq->elem_size);
+    atomic_store_explicit(&slot->pinned, rq->elem_pinned && rq->elem_pinned(data),
+                          memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    return 0;
+}
+
+/* claim the slot at the head and empty it; AVERROR(EAGAIN) if empty, or if
+ * evicting and the item is pinned */
+static int pop(RingQueue *rq, void *data, int evict)
+{
+    size_t pos = atomic_load_explicit(&rq->head, memory_order_relaxed);
+    RingSlot *slot;
+
+    while (1) {
+        size_t   seq;
+        intptr_t dif;
+
+        slot = slot_at(rq, pos);
+        seq  = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        dif  = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (dif == 0) {
+            /* a value from a later lap means the slot was claimed meanwhile,
+             * refusing then is merely spurious */
+            if (evict && atomic_load_explicit(&slot->pinned, memory_order_relaxed))
+                return AVERROR(EAGAIN);
+            if (atomic_compare_exchange_weak_explicit(&rq->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return AVERROR(EAGAIN);
+        } else {
+            pos = atomic_load_explicit(&rq->head, memory_order_relaxed);
+        }
+    }
+
+    memcpy(data, slot_data(slot), rq->elem_size);
+    atomic_store_explicit(&slot->seq, pos + rq->mask + 1, memory_order_release);
+
+    return 0;
+}
+
+static int send_or_fail(RingQueue *rq, const void *data)
+{
+    int finished = atomic_load_explicit(&rq->finished, memory_order_acquire);
+
+    if (finished & FINISHED_SEND)
+        return AVERROR(EINVAL);
+    if (finished & FINISHED_RECV)
+        return AVERROR_EOF;
+
+    return push(rq, data);
+}
+
+int rq_try_send(RingQueue *rq, const void *data)
+{
+    int ret = send_or_fail(rq, data);
+
+    if (ret >= 0)
+        wake_waiters(rq, &rq->recv_waiters, &rq->recv_cond);
+
+    return ret;
+}
+
+int rq_send(RingQueue *rq, const void *data)
+{
+    int ret = send_or_fail(rq, data);
+
+    if (ret == AVERROR(EAGAIN)) {
+        pthread_mutex_lock(&rq->lock);
+        atomic_fetch_add(&rq->send_waiters, 1);
+
+        while ((ret = send_or_fail(rq, data)) == AVERROR(EAGAIN))
+            pthread_cond_wait(&rq->send_cond, &rq->lock);
+
+        atomic_fetch_sub(&rq->send_waiters, 1);
+        pthread_mutex_unlock(&rq->lock);
+    }
+
+    if (ret >= 0)
+        wake_waiters(rq, &rq->recv_waiters, &rq->recv_cond);
+
+    return ret;
+}
+
+static int receive_or_eof(RingQueue *rq, void *data)
+{
+    int ret = pop(rq, data, 0);
+
+    if (ret != AVERROR(EAGAIN))
+        return ret;
+
+    /* the finish flag is set after the last item was sent, so check the
+     * queue once more after seeing it */
+    if (atomic_load_explicit(&rq->finished, memory_order_acquire) & FINISHED_SEND) {
+        ret = pop(rq, data, 0);
+        return ret == AVERROR(EAGAIN) ? AVERROR_EOF : ret;
+    }
+
+    return AVERROR(EAGAIN);
+}
+
+/* The finishing sender may still hold the lock when the receiver sees the
+ * flag; wait for it to release the lock so the caller can free the queue as
+ * soon as it gets AVERROR_EOF. */
+static void sync_with_finish(RingQueue *rq)
+{
+    pthread_mutex_lock(&rq->lock);
+    pthread_mutex_unlock(&rq->lock);
+}
+
+int rq_try_receive(RingQueue *rq, void *data)
+{
+    int ret = receive_or_eof(rq, data);
+
+    if (ret >= 0)
+        wake_waiters(rq, &rq->send_waiters, &rq->send_cond);
+    else if (ret == AVERROR_EOF)
+        sync_with_finish(rq);
+
+    return ret;
+}
+
+int rq_try_evict(RingQueue *rq, void *data)
+{
+    int ret = pop(rq, data, 1);
+
+    if (ret >= 0)
+        wake_waiters(rq, &rq->send_waiters, &rq->send_cond);
+
+    return ret;
+}
+
+/* wait for an item until abstime, or indefinitely if abstime is NULL */
+static int receive_wait(RingQueue *rq, void *data, const struct timespec *abstime)
+{
+    int ret = receive_or_eof(rq, data);
+
+    if (ret == AVERROR(EAGAIN)) {
+        pthread_mutex_lock(&rq->lock);
+        atomic_fetch_add(&rq->recv_waiters, 1);
+
+        while ((ret = receive_or_eof(rq, data)) == AVERROR(EAGAIN)) {
+            if (!abstime) {
+                pthread_cond_wait(&rq->recv_cond, &rq->lock);
+            } else if (pthread_cond_timedwait(&rq->recv_cond, &rq->lock, abstime)) {
+                ret = receive_or_eof(rq, data);
+                break;
+            }
+        }
+
+        atomic_fetch_sub(&rq->recv_waiters, 1);
+        pthread_mutex_unlock(&rq->lock);
+    } else if (ret == AVERROR_EOF) {
+        sync_with_finish(rq);
+    }
+
+    if (ret >= 0)
+        wake_waiters(rq, &rq->send_waiters, &rq->send_cond);
+
+    return ret;
+}
+
+int rq_receive(RingQueue *rq, void *data)
+{
+    return receive_wait(rq, data, NULL);
+}
+
+int rq_receive_timeout(RingQueue *rq, void *data, int64_t timeout_us)
+{
+    struct timespec abstime;
+    int64_t t;
+
+    if (timeout_us <= 0)
+        return rq_try_receive(rq, data);
+
+    /* pthread_cond_timedwait() takes a wall-clock deadline */
+    t = av_gettime() + timeout_us;
+    abstime.tv_sec  = t / 1000000;
+    abstime.tv_nsec = (t % 1000000) * 1000;
+
+    return receive_wait(rq, data, &abstime);
+}
+
+static void finish(RingQueue *rq, int flag)
+{
+    pthread_mutex_lock(&rq->lock);
+    atomic_fetch_or(&rq->finished, flag);
+    pthread_cond_broadcast(&rq->send_cond);
+    pthread_cond_broadcast(&rq->recv_cond);
+    pthread_mutex_unlock(&rq->lock);
+}
+
+void rq_send_finish(RingQueue *rq)
+{
+    finish(rq, FINISHED_SEND);
+}
+
+void rq_receive_finish(RingQueue *rq)
+{
+    finish(rq, FINISHED_RECV);
+}
@@ -0,0 +1,96 @@
+#ifndef FFTOOLS_RING_QUEUE_H
+#define FFTOOLS_RING_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Bounded lock-free queue of fixed-size items.
+ *
+ * Items are copied into preallocated slots, each slot carrying a sequence
+ * number, so senders and receivers never take a lock while the queue is
+ * neither full nor empty. Only a side that has to wait parks on a mutex and
+ * condition variable, and the opposite side signals it only when it sees a
+ * parked waiter.
+ *
+ * Any number of threads may send and receive concurrently.
+ */
+typedef struct RingQueue RingQueue;
+
+/**
+ * Allocate a queue.
+ *
+ * @param capacity number of items that can be stored without blocking,
+ *                 rounded up to a power of two
+ * @param elem_size size of one item in bytes
+ * @param elem_reset if non-NULL, called by rq_free() on every item still
+ *                   stored in the queue
+ */
+RingQueue *rq_alloc(size_t capacity, size_t elem_size,
+                    void (*elem_reset)(void *elem));
+void       rq_free(RingQueue **rq);
+
+/**
+ * @return the number of items the queue can hold
+ */
+size_t rq_capacity(const RingQueue *rq);
+
+/**
+ * Set a callback telling which items rq_try_evict() must leave in the queue.
+ * It is called on every item sent, so it must be set before sending any.
+ */
+void rq_set_pinned(RingQueue *rq, int (*elem_pinned)(const void *elem));
+
+/**
+ * Copy an item into the queue, waiting for a free slot if the queue is full.
+ *
+ * @return
+ * - 0 the item was successfully sent
+ * - AVERROR(EINVAL) the sending side has previously been marked as finished
+ * - AVERROR_EOF the receiving side has been marked as finished
+ */
+int rq_send(RingQueue *rq, const void *data);
+/**
+ * Same as rq_send(), but return AVERROR(EAGAIN) instead of waiting when the
+ * queue is full.
+ */
+int rq_try_send(RingQueue *rq, const void *data);
+/**
+ * Mark the queue finished from the sending side. Receivers get AVERROR_EOF
+ * once all the items sent before have been received.
+ */
+void rq_send_finish(RingQueue *rq);
+
+/**
+ * Copy the oldest item out of the queue, waiting for one if it is empty.
+ *
+ * @return
+ * - 0 an item was written to data
+ * - AVERROR_EOF the sending side has finished and the queue is empty
+ */
+int rq_receive(RingQueue *rq, void *data);
+/**
+ * Same as rq_receive(), but return AVERROR(EAGAIN) instead of waiting when the
+ * queue is empty.
+ */
+int rq_try_receive(RingQueue *rq, void *data);
+/**
+ * Same as rq_try_receive(), but leave the oldest item in the queue if it is
+ * pinned, see rq_set_pinned(), and never report the end of the queue.
+ *
+ * @return 0 if the item was removed and written to data, AVERROR(EAGAIN) if
+ *         the queue is empty or the oldest item is pinned
+ */
+int rq_try_evict(RingQueue *rq, void *data);
+/**
+ * Same as rq_receive(), but return AVERROR(EAGAIN) if no item arrives within
+ * timeout_us microseconds.
+ */
+int rq_receive_timeout(RingQueue *rq, void *data, int64_t timeout_us);
+/**
+ * Mark the queue finished from the receiving side. Waiting and subsequent
+ * senders get AVERROR_EOF.
+ */
+void rq_receive_finish(RingQueue *rq);
+
+#endif // FFTOOLS_RING_QUEUE_H
@@ -0,0 +1,243 @@
+#include <stdint.h>
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "thread_pool.h"
+
+typedef struct ThreadPoolWorker {
+    struct ThreadPoolWorker *next;
+    ThreadPool              *tp;
+
+    void (*func)(void *arg);
+    void  *arg;
+    /* set when the worker is unlinked from the idle stack without a job */
+    int    exit;
+
+    /* joined once the worker exited, which releases the thread on every
+     * platform; w32threads also needs it to stay valid until then */
+    pthread_t      thread;
+    pthread_cond_t cond;
+} ThreadPoolWorker;
+
+struct ThreadPool {
+    /* stack of parked workers, most recently used first */
+    ThreadPoolWorker *idle;
+    unsigned int   nb_idle;
+    unsigned int  max_idle;
+    /* parked + running workers */
+    unsigned int nb_workers;
+    /* workers that exited and wait to be joined by tp_submit() or tp_free() */
+    ThreadPoolWorker *exited;
+
+    int finishing;
+
+    pthread_mutex_t lock;
+    /* signalled whenever a worker exits */
+    pthread_cond_t  cond;
+};
+
+static void *worker_thread(void *arg)
+{
+    ThreadPoolWorker *w = arg;
+    ThreadPool      *tp = w->tp;
+
+    pthread_mutex_lock(&tp->lock);
+
+    while (1) {
+        void (*func)(void *arg);
+        void  *func_arg;
+
+        while (!w->func && !w->exit)
+            pthread_cond_wait(&w->cond, &tp->lock);
+
+        if (!w->func)
+            break;
+
+        func     = w->func;
+        func_arg = w->arg;
+        w->func  = NULL;
+        w->arg   = NULL;
+
+        pthread_mutex_unlock(&tp->lock);
+        func(func_arg);
+        pthread_mutex_lock(&tp->lock);
+
+        if (tp->finishing || tp->nb_idle >= tp->max_idle)
+            break;
+
+        w->next  = tp->idle;
+        tp->idle = w;
+        tp->nb_idle++;
+    }
+
+    tp->nb_workers--;
+    w->next    = tp->exited;
+    tp->exited = w;
+    pthread_cond_broadcast(&tp->cond);
+
+    pthread_mutex_unlock(&tp->lock);
+
+    return NULL;
+}
+
+/* join and free a list of exited workers, must be called without the lock */
+static void join_workers(ThreadPoolWorker *w)
+{
+    while (w) {
+        ThreadPoolWorker *next = w->next;
+
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->cond);
+        av_free(w);
+        w = next;
+    }
+}
+
+/* must be called with the lock held */
+static void trim_idle_locked(ThreadPool *tp, unsigned int keep)
+{
+    while (tp->nb_idle > keep) {
+        ThreadPoolWorker *w = tp->idle;
+        tp->idle = w->next;
+        tp->nb_idle--;
+        w->next = NULL;
+        w->exit = 1;
+        pthread_cond_signal(&w->cond);
+    }
+}
+
+ThreadPool *tp_alloc(unsigned int max_idle)
+{
+    ThreadPool *tp;
+    int ret;
+
+    tp = av_mallocz(sizeof(*tp));
+    if (!tp)
+        return NULL;
+
+    ret = pthread_mutex_init(&tp->lock, NULL);
+    if (ret) {
+        av_freep(&tp);
+        return NULL;
+    }
+
+    ret = pthread_cond_init(&tp->cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&tp->lock);
+        av_freep(&tp);
+        return NULL;
+    }
+
+    tp->max_idle = max_idle;
+
+    return tp;
+}
+
+void tp_free(ThreadPool **ptp)
+{
+    ThreadPool *tp = *ptp;
+
+    if (!tp)
+        return;
+
+    pthread_mutex_lock(&tp->lock);
+
+    tp->finishing = 1;
+    trim_idle_locked(tp, 0);
+
+    while (tp->nb_workers)
+        pthread_cond_wait(&tp->cond, &tp->lock);
+
+    pthread_mutex_unlock(&tp->lock);
+
+    join_workers(tp->exited);
+
+    pthread_cond_destroy(&tp->cond);
+    pthread_mutex_destroy(&tp->lock);
+
+    av_freep(ptp);
+}
+
+void tp_set_max_idle(ThreadPool *tp, unsigned int max_idle)
+{
+    pthread_mutex_lock(&tp->lock);
+    tp->max_idle = max_idle;
+    trim_idle_locked(tp, max_idle);
+    pthread_mutex_unlock(&tp->lock);
+}
+
+int tp_submit(ThreadPool *tp, void (*func)(void *arg), void *arg)
+{
+    ThreadPoolWorker *w, *exited;
+    int ret;
+
+    pthread_mutex_lock(&tp->lock);
+
+    if (tp->finishing) {
+        pthread_mutex_unlock(&tp->lock);
+        return AVERROR(EINVAL);
+    }
+
+    exited     = tp->exited;
+    tp->exited = NULL;
+
+    if (tp->idle) {
+        w = tp->idle;
+        tp->idle = w->next;
+        tp->nb_idle--;
+
+        w->next = NULL;
+        w->func = func;
+        w->arg  = arg;
+        pthread_cond_signal(&w->cond);
+
+        pthread_mutex_unlock(&tp->lock);
+        join_workers(exited);
+        return 0;
+    }
+
+    tp->nb_workers++;
+
+    pthread_mutex_unlock(&tp->lock);
+
+    join_workers(exited);
+
+    w = av_mallocz(sizeof(*w));
+    if (!w) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = pthread_cond_init(&w->cond, NULL);
+    if (ret) {
+        av_freep(&w);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    w->tp   = tp;
+    w->func = func;
+    w->arg  = arg;
+
+    /* the worker takes the lock first, so it cannot exit and be joined
+     * before w->thread is set */
+    pthread_mutex_lock(&tp->lock);
+    ret = pthread_create(&w->thread, NULL, worker_thread, w);
+    pthread_mutex_unlock(&tp->lock);
+    if (ret) {
+        pthread_cond_destroy(&w->cond);
+        av_freep(&w);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    pthread_mutex_lock(&tp->lock);
+    tp->nb_workers--;
+    pthread_cond_broadcast(&tp->cond);
+    pthread_mutex_unlock(&tp->lock);
+    return ret;
+}
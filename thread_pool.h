@@ -0,0 +1,40 @@
+#ifndef FFTOOLS_THREAD_POOL_H
+#define FFTOOLS_THREAD_POOL_H
+
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * Allocate a pool of long-lived worker threads.
+ *
+ * Workers are created on demand, so submitting never waits for another job to
+ * finish. When a job returns, its worker parks itself for reuse unless
+ * max_idle workers are already parked, in which case it exits.
+ *
+ * @param max_idle maximum number of parked workers kept alive between jobs
+ */
+ThreadPool *tp_alloc(unsigned int max_idle);
+
+/**
+ * Stop all parked workers and free the pool once every running job has
+ * returned.
+ */
+void tp_free(ThreadPool **tp);
+
+/**
+ * Change the number of parked workers kept alive between jobs. Surplus parked
+ * workers exit immediately.
+ */
+void tp_set_max_idle(ThreadPool *tp, unsigned int max_idle);
+
+/**
+ * Run func(arg) on a parked worker, or on a newly created one if none is
+ * parked.
+ *
+ * The job must leave any thread-local state it relies on in a state the next
+ * job can reset; the pool itself does not touch it.
+ *
+ * @return 0 on success, a negative AVERROR code if no worker could be started
+ */
+int tp_submit(ThreadPool *tp, void (*func)(void *arg), void *arg);
+
+#endif // FFTOOLS_THREAD_POOL_H